@@ -4,13 +4,34 @@
 set -e
 
 SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
-PROJECT_ROOT="${SCRIPT_DIR}/../.."
+PROJECT_ROOT="${SCRIPT_DIR}/.."
 BINARY="${PROJECT_ROOT}/build/bgp_sim"
+BENCH="${PROJECT_ROOT}/build/bgp_bench"
 
-# Dataset selection: default mini tests (scripts/tests), optional "large" (scripts/tests/test_*.csv)
+# Dataset selection: default mini tests (scripts/tests), optional "large" (scripts/tests/test_*.csv),
+# or "synthetic [baseline_dir]": bgp_bench at several scales, JSON results in bench_results/
 DATASET="${1:-mini}"
 TEST_DIR="${SCRIPT_DIR}/tests"
 
+if [[ "${DATASET}" == "synthetic" ]]; then
+  BASELINE_DIR="${2:-}"
+  OUT_DIR="${PROJECT_ROOT}/bench_results"
+  (cd "${PROJECT_ROOT}" && bash scripts/build.sh >/dev/null)
+  mkdir -p "${OUT_DIR}"
+  status=0
+  for scale in "10000 1000" "100000 1000" "1000000 100"; do
+    read -r ases prefixes <<< "${scale}"
+    name="ases${ases}_prefixes${prefixes}"
+    args=(--ases "${ases}" --prefixes "${prefixes}" --threads 0 --json "${OUT_DIR}/${name}.json")
+    if [[ -n "${BASELINE_DIR}" && -f "${BASELINE_DIR}/${name}.json" ]]; then
+      args+=(--compare "${BASELINE_DIR}/${name}.json")
+    fi
+    echo "[BENCH] ${name}"
+    "${BENCH}" "${args[@]}" || status=$?
+  done
+  exit "${status}"
+fi
+
 if [[ "${DATASET}" == "large" ]]; then
   ANN="${TEST_DIR}/test_anns.csv"
   ROV="${TEST_DIR}/test_rov.csv"
@@ -25,7 +46,7 @@ if [[ ! -f "${ANN}" || ! -f "${ROV}" ]]; then
 fi
 
 # Build Release binary
-bash "${PROJECT_ROOT}/scripts/build.sh" >/dev/null
+(cd "${PROJECT_ROOT}" && bash scripts/build.sh >/dev/null)
 
 if [[ ! -x "${BINARY}" ]]; then
   echo "[ERROR] Binary not found after build: ${BINARY}" >&2
@@ -48,7 +69,7 @@ run_bench() {
 # Single-thread baseline
 run_bench ""
 
-# Multi-thread runs (clamped by simulator to <=16 and hardware concurrency)
+# Multi-thread runs
 for t in 2 4 8 16; do
   run_bench "${t}"
 done
@@ -6,11 +6,36 @@ set -e
 SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
 PROJECT_ROOT="${SCRIPT_DIR}/.."
 BINARY="${PROJECT_ROOT}/build/bgp_sim"
+QUERY="${PROJECT_ROOT}/build/bgp_query"
+CONES="${PROJECT_ROOT}/build/bgp_cones"
 TEST_DIR="${SCRIPT_DIR}/tests"
 
 # 1) Build in Release mode
 bash "${SCRIPT_DIR}/build.sh" >/dev/null
 
+# The simulator reads data/as-rel.txt.bz2 from its working directory: tests
+# run in scratch directories holding a test graph, the mini graph by default
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "${WORK_DIR}"' EXIT
+graph_dir() {
+  mkdir -p "$2/data"
+  bzip2 -c "$1" >"$2/data/as-rel.txt.bz2"
+}
+graph_dir "${TEST_DIR}/mini_as-rel.txt" "${WORK_DIR}"
+cd "${WORK_DIR}"
+
+# Compares two CSV files row for row after sorting (row order is not part of the output contract)
+expect_rows() {
+  local actual="$1" expected="$2" name="$3"
+  if cmp -s <(sort "${actual}") <(sort "${expected}"); then
+    echo "[OK] ${name} passed"
+  else
+    echo "[FAIL] ${name} FAILED" >&2
+    diff <(sort "${expected}") <(sort "${actual}") >&2 || true
+    exit 1
+  fi
+}
+
 # 2) Run simulator on mini test data
 ACTUAL="${TEST_DIR}/mini_actual.csv"
 ACTUAL_MT="${TEST_DIR}/mini_actual_mt.csv"
@@ -55,3 +80,173 @@ else
   echo "[FAIL] Multi-threaded regression test FAILED" >&2
   exit 1
 fi
+
+# 6) Prefix-batched run (one prefix per batch, batches on separate threads) should produce identical result
+ACTUAL_BATCH="${TEST_DIR}/mini_actual_batch.csv"
+"${BINARY}" "${TEST_DIR}/mini_anns.csv" "${TEST_DIR}/mini_rov.csv" 2 --prefix-batch 1 >"${ACTUAL_BATCH}"
+
+tail -n +2 "${ACTUAL_BATCH}" | sort >"${ACTUAL_BATCH}.sorted"
+
+if cmp -s "${ACTUAL_BATCH}.sorted" "${EXPECTED}.sorted"; then
+  echo "[OK] Prefix-batched regression test passed"
+else
+  echo "[FAIL] Prefix-batched regression test FAILED" >&2
+  exit 1
+fi
+
+# 7) Incremental re-simulation: store a run, change the ROV list, and re-run
+# against the store; the output must be byte-identical to a full run. The
+# second prefix has no invalid announcement, so it is restored from the store.
+{ cat "${TEST_DIR}/mini_anns.csv"; echo "2,5.0.0.0/8,False"; } >anns_two.csv
+echo 4 >rov_changed.csv
+"${BINARY}" anns_two.csv "${TEST_DIR}/mini_rov.csv" --result-store mini.store >/dev/null
+"${BINARY}" anns_two.csv rov_changed.csv --baseline mini.store >baseline_actual.csv
+"${BINARY}" anns_two.csv rov_changed.csv >full_actual.csv
+
+if cmp -s baseline_actual.csv full_actual.csv; then
+  echo "[OK] Baseline re-simulation test passed"
+else
+  echo "[FAIL] Baseline re-simulation test FAILED" >&2
+  exit 1
+fi
+
+# 8) Batch mode: jobs from stdin on one loaded graph, including a missing input
+# file and a malformed line. Every job gets one reply (the trailing run time
+# is dropped before comparing) and the good jobs write the usual CSVs.
+printf '%s\n' "${TEST_DIR}/mini_anns.csv ${TEST_DIR}/mini_rov.csv batch_1.csv" \
+  "anns_two.csv rov_changed.csv batch_2.csv" \
+  "missing.csv rov_changed.csv batch_3.csv" \
+  "malformed" | "${BINARY}" --batch 2 | sed -E 's/^(ok [^ ]+ [0-9]+) [0-9]+$/\1/' >batch_replies.txt
+printf '%s\n' "ok batch_1.csv 1" "ok batch_2.csv 2" \
+  "error missing.csv: cannot open announcements file" \
+  "error malformed: expected <anns.csv> <rov_asns.csv> <output.csv|-> [result-store]" >batch_expected.txt
+
+expect_rows batch_replies.txt batch_expected.txt "Batch mode reply"
+expect_rows batch_1.csv "${EXPECTED}" "Batch mode job 1"
+expect_rows batch_2.csv full_actual.csv "Batch mode job 2"
+if [[ -e batch_3.csv ]]; then
+  echo "[FAIL] Batch mode wrote the output of a failed job" >&2
+  exit 1
+fi
+
+# 9) Socket mode: one client sends a job and half-closes its end. It must get
+# its reply and then end of file, since the server closes a connection once
+# the client's last job is answered.
+SOCKET="${WORK_DIR}/bgp_sim.sock"
+"${BINARY}" --socket "${SOCKET}" 2 2>/dev/null &
+SERVER_PID=$!
+socket_client() {
+  python3 - "${SOCKET}" "$1" <<'PY'
+import socket, sys, time
+path, line = sys.argv[1], sys.argv[2]
+for _ in range(100):
+    try:
+        conn = socket.socket(socket.AF_UNIX)
+        conn.connect(path)
+        break
+    except OSError:
+        time.sleep(0.1)
+else:
+    sys.exit("no server listening on " + path)
+conn.settimeout(10)  # a connection left open after the reply times out here
+conn.sendall((line + "\n").encode())
+conn.shutdown(socket.SHUT_WR)
+reply = b""
+try:
+    while chunk := conn.recv(4096):
+        reply += chunk
+except socket.timeout:
+    sys.exit("no end of file after reply " + repr(reply.decode()))
+sys.stdout.write(reply.decode())
+PY
+}
+SOCKET_REPLY="$(socket_client "${TEST_DIR}/mini_anns.csv ${TEST_DIR}/mini_rov.csv ${WORK_DIR}/socket_1.csv")" || {
+  kill "${SERVER_PID}" 2>/dev/null
+  echo "[FAIL] Socket mode test FAILED" >&2
+  exit 1
+}
+socket_client shutdown >/dev/null
+wait "${SERVER_PID}"
+
+if [[ "${SOCKET_REPLY}" == "ok ${WORK_DIR}/socket_1.csv 1 "* ]]; then
+  expect_rows socket_1.csv "${EXPECTED}" "Socket mode round trip"
+else
+  echo "[FAIL] Socket mode reply: '${SOCKET_REPLY}'" >&2
+  exit 1
+fi
+
+# 10) Routing policies on the policy graph: peer lock at AS 1, customer-only
+# at AS 4, ASPA at AS 1 (customer routes must climb) and AS 5 (provider routes
+# need an up and a down ramp without failed hops), single- and multi-threaded
+graph_dir "${TEST_DIR}/policy_as-rel.txt" "${WORK_DIR}/policy"
+: >"${WORK_DIR}/policy/no_rov.csv"
+for threads in 1 3; do
+  (cd "${WORK_DIR}/policy" && "${BINARY}" "${TEST_DIR}/policy_anns.csv" no_rov.csv "${threads}" \
+    --policies "${TEST_DIR}/policy_policies.csv" --aspa "${TEST_DIR}/policy_aspa.csv") >"policy_actual_${threads}.csv"
+  expect_rows "policy_actual_${threads}.csv" "${TEST_DIR}/policy_expected.csv" "Routing policy test (${threads} threads)"
+done
+
+# 11) Stub collapsing: the mini graph's single-homed stub gets its rows
+# derived from its provider's RIB at output; they must be those of a full run,
+# unbatched and batched (concurrent one-prefix batches on the two-prefix input)
+"${BINARY}" "${TEST_DIR}/mini_anns.csv" "${TEST_DIR}/mini_rov.csv" --collapse-stubs >collapse_actual.csv
+expect_rows collapse_actual.csv "${EXPECTED}" "Collapsed-stub test"
+"${BINARY}" "${TEST_DIR}/mini_anns.csv" "${TEST_DIR}/mini_rov.csv" 2 --prefix-batch 1 --collapse-stubs \
+  >collapse_batch_actual.csv
+expect_rows collapse_batch_actual.csv "${EXPECTED}" "Collapsed-stub prefix-batched test"
+"${BINARY}" anns_two.csv rov_changed.csv 2 --prefix-batch 1 --collapse-stubs >collapse_two_actual.csv
+expect_rows collapse_two_actual.csv full_actual.csv "Collapsed-stub concurrent batches test"
+
+# 12) ROV sweep: two deployments propagated as lanes of one run; each lane's
+# file must hold the rows of a separate run with that ROV list
+printf '%s\n' "# rov_asns.csv output.csv" "${TEST_DIR}/mini_rov.csv sweep_lane_0.csv" \
+  "rov_changed.csv sweep_lane_1.csv" >sweep.txt
+"${BINARY}" --sweep sweep.txt anns_two.csv 2
+"${BINARY}" anns_two.csv "${TEST_DIR}/mini_rov.csv" >single_lane_0.csv
+expect_rows sweep_lane_0.csv single_lane_0.csv "ROV sweep lane 0"
+expect_rows sweep_lane_1.csv full_actual.csv "ROV sweep lane 1"
+
+# 13) Forwarding queries on a store of nested prefixes (/0, /8, /16, /24 split
+# by a /25 and a /32): longest-prefix match, fallback to the covering prefix
+# for ASes without a route for the longest match, hop-by-hop forwarding; and
+# on a store of two spellings of one /8, where the lower PrefixID must win
+run_fib_queries() {
+  grep -v '^#' "$2" | while read -r command asn address; do
+    "${QUERY}" "$1" "${command}" "${asn}" "${address}"
+  done
+}
+"${BINARY}" "${TEST_DIR}/fib_anns.csv" "${TEST_DIR}/mini_rov.csv" --result-store fib.store --no-csv
+run_fib_queries fib.store "${TEST_DIR}/fib_queries.txt" >fib_actual.txt
+"${QUERY}" fib.store forward-batch 2 <"${TEST_DIR}/fib_batch.txt" 2>/dev/null >fib_batch_actual.csv
+"${BINARY}" "${TEST_DIR}/fib_overlap_anns.csv" "${TEST_DIR}/mini_rov.csv" --result-store fib_overlap.store --no-csv
+run_fib_queries fib_overlap.store "${TEST_DIR}/fib_overlap_queries.txt" >fib_overlap_actual.txt
+
+if cmp -s fib_actual.txt "${TEST_DIR}/fib_expected.txt" && cmp -s fib_batch_actual.csv "${TEST_DIR}/fib_batch_expected.csv" &&
+  cmp -s fib_overlap_actual.txt "${TEST_DIR}/fib_overlap_expected.txt"; then
+  echo "[OK] Forwarding query test passed"
+else
+  echo "[FAIL] Forwarding query test FAILED" >&2
+  diff "${TEST_DIR}/fib_expected.txt" fib_actual.txt >&2 || true
+  diff "${TEST_DIR}/fib_batch_expected.csv" fib_batch_actual.csv >&2 || true
+  diff "${TEST_DIR}/fib_overlap_expected.txt" fib_overlap_actual.txt >&2 || true
+  exit 1
+fi
+
+# 14) Customer cones and valley-free reachability: the mini graph, and a graph
+# where ASes are only reachable through a valley (up after a peer link, or a
+# peer link after going down), which must be reported unreachable
+run_cone_queries() {
+  grep -v '^#' "$1" | while read -r -a args; do "${CONES}" "${args[@]}" 2>/dev/null; done
+}
+run_cone_queries "${TEST_DIR}/mini_cones_queries.txt" >mini_cones_actual.txt
+graph_dir "${TEST_DIR}/cones_as-rel.txt" "${WORK_DIR}/cones"
+(cd "${WORK_DIR}/cones" && run_cone_queries "${TEST_DIR}/cones_queries.txt") >cones_actual.txt
+
+if cmp -s mini_cones_actual.txt "${TEST_DIR}/mini_cones_expected.txt" && cmp -s cones_actual.txt "${TEST_DIR}/cones_expected.txt"; then
+  echo "[OK] Customer cone test passed"
+else
+  echo "[FAIL] Customer cone test FAILED" >&2
+  diff "${TEST_DIR}/mini_cones_expected.txt" mini_cones_actual.txt >&2 || true
+  diff "${TEST_DIR}/cones_expected.txt" cones_actual.txt >&2 || true
+  exit 1
+fi
@@ -0,0 +1,60 @@
+#include "allocator.h"
+#include <algorithm>
+#include <new>
+#include <sys/mman.h>
+
+static constexpr std::size_t kPageSize = 4096;
+static constexpr std::size_t kHugePageSize = std::size_t{2} << 20;
+
+Arena::Arena(std::size_t block_size, bool huge_pages) : block_size(block_size), huge_pages(huge_pages) {}
+
+Arena::~Arena() { release(); }
+
+Arena::Block Arena::map_block(std::size_t bytes) const {
+    const std::size_t page = huge_pages ? kHugePageSize : kPageSize;
+    bytes = (std::max<std::size_t>(bytes, 1) + page - 1) / page * page;
+    void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+    if (huge_pages) ::madvise(p, bytes, MADV_HUGEPAGE);  // a hint: without THP the block just uses small pages
+#endif
+    return {static_cast<char*>(p), bytes};
+}
+
+void* Arena::allocate_bytes(std::size_t bytes, std::size_t align) {
+    for (;;) {
+        if (current < blocks.size()) {
+            const Block& b = blocks[current];
+            const uintptr_t base = reinterpret_cast<uintptr_t>(b.base);
+            const std::size_t offset = ((base + used + align - 1) & ~uintptr_t{align - 1}) - base;
+            if (offset + bytes <= b.size) {
+                used = offset + bytes;
+                return b.base + offset;
+            }
+            // Retained blocks after a rewind are reused before new ones are mapped
+            if (current + 1 < blocks.size()) {
+                ++current;
+                used = 0;
+                continue;
+            }
+        }
+        blocks.push_back(map_block(std::max(bytes + align, block_size)));
+        current = blocks.size() - 1;
+        used = 0;
+    }
+}
+
+void Arena::reset(std::size_t capacity) {
+    current = 0;
+    used = 0;
+    if (capacity == 0 || (!blocks.empty() && blocks.front().size >= capacity)) return;
+    release();
+    blocks.push_back(map_block(capacity));
+}
+
+void Arena::release() {
+    for (const Block& b : blocks) ::munmap(b.base, b.size);
+    blocks.clear();
+    current = 0;
+    used = 0;
+}
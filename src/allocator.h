@@ -1,16 +1,61 @@
+// Arena - bump allocator over large mmap'd blocks, released in one bulk reset
+// Backs the per-run RIB/queue tables and the per-thread scratch pool; blocks can use transparent huge pages
 #pragma once
-#include <vector>
+
+#include <cstddef>
 #include <cstdint>
-class Mempool {
-  std::vector<char> pool;
-  std::vector<void*> free_list;
+#include <type_traits>
+#include <vector>
+
+class Arena {
 public:
-  Mempool(size_t capacity = 1<<24) : pool(capacity) {}
-  template<typename T> T* alloc() {
-    if (!free_list.empty()) {
-      T* ptr = static_cast<T*>(free_list.back()); free_list.pop_back(); return ptr;
+    // Allocation position; rewinding to it frees everything allocated after it
+    struct Mark {
+        std::size_t block = 0;
+        std::size_t used = 0;
+    };
+
+    // block_size: size of the blocks mapped on demand. huge_pages: ask for
+    // transparent huge pages (madvise), which cuts TLB misses on large tables
+    explicit Arena(std::size_t block_size = std::size_t{1} << 20, bool huge_pages = false);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Uninitialized storage for n objects; nothing is constructed or destroyed,
+    // and pages that are never written are never committed by the OS
+    template <typename T>
+    T* allocate(std::size_t n) {
+        static_assert(std::is_trivially_destructible_v<T>, "arena memory is freed without running destructors");
+        return static_cast<T*>(allocate_bytes(n * sizeof(T), alignof(T)));
+    }
+    void* allocate_bytes(std::size_t bytes, std::size_t align);
+
+    Mark mark() const { return {current, used}; }
+    // Marks must be rewound in reverse order of taking them; blocks stay mapped
+    void rewind(Mark m) {
+        current = m.block;
+        used = m.used;
     }
-    return new T; // fallback
-  }
-  template<typename T> void free(T* ptr) { free_list.push_back(ptr); }
+
+    // Frees everything at once. If capacity is set and the first block is
+    // smaller, all blocks are replaced by one block of capacity bytes, so the
+    // next run's storage is contiguous and mapped once.
+    void reset(std::size_t capacity = 0);
+    // Unmaps every block
+    void release();
+
+private:
+    struct Block {
+        char* base;
+        std::size_t size;
+    };
+    Block map_block(std::size_t bytes) const;
+
+    std::vector<Block> blocks;
+    std::size_t current = 0;  // block being filled
+    std::size_t used = 0;     // bytes used in blocks[current]
+    std::size_t block_size;
+    bool huge_pages;
 };
@@ -1,26 +1,48 @@
 #pragma once
+#include <bit>
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <cstring>
 
 typedef uint32_t ASN;
 
 typedef uint32_t PrefixID;
 
-// Relationship types for BGP announcements
-enum Rel { ORIGIN = 3, CUST = 2, PEER = 1, PROV = 0 };
+// Relationship types for BGP announcements (from the receiving AS's point of view)
+enum Rel : uint8_t { ORIGIN = 3, CUST = 2, PEER = 1, PROV = 0 };
 
-// Structure for BGP announcements
+// Compact RIB entry for BGP announcements.
+// The AS path is not stored: it is rebuilt at output time by following next_hop
+// through the neighbors' RIBs until the ORIGIN entry is reached.
 struct Announcement {
-  PrefixID prefix_id;    // Identifier for destination IP prefix
-  std::vector<ASN> as_path;  // Path of ASNs
-  ASN next_hop;          // Next-hop ASN
+  ASN next_hop;          // Next-hop ASN (the origin itself for ORIGIN entries)
+  uint16_t path_len;     // Length of the AS path including the owning AS
   Rel rel;               // Relationship type (provider/customer/peer/origin)
   bool rov_invalid;      // True if ROV marks this announcement as invalid
-  // Comparison operator for prioritization
-  bool operator>(const Announcement& other) const {
-    if (rel != other.rel) return rel > other.rel;
-    if (as_path.size() != other.as_path.size()) return as_path.size() < other.as_path.size();
-    return next_hop < other.next_hop;
-  }
-};
\ No newline at end of file
+  // Comparison operator for prioritization: relationship, then shorter path, then lower next_hop
+  bool operator>(const Announcement& other) const;
+};
+
+static_assert(sizeof(Announcement) == 8 && std::endian::native == std::endian::little,
+              "route keys read an Announcement as one little-endian 64-bit word");
+
+// An entry read as a 64-bit word: next_hop in bits 0-31, path_len in 32-47,
+// rel in 48-55 and rov_invalid in 56-63
+inline uint64_t route_bits(const Announcement& ann) {
+  uint64_t bits;
+  std::memcpy(&bits, &ann, sizeof(bits));
+  return bits;
+}
+
+// Packed preference key: a > b exactly when route_key(a) > route_key(b). Keeps
+// rel, inverts path_len and next_hop (lower wins) and clears the ROV byte, so
+// the whole selection rule is one unsigned compare (and stays below 2^56, so
+// signed SIMD compares work as well).
+inline uint64_t route_key(uint64_t bits) {
+  return (bits ^ 0x0000FFFFFFFFFFFFull) & 0x00FFFFFFFFFFFFFFull;
+}
+
+inline bool Announcement::operator>(const Announcement& other) const {
+  return route_key(route_bits(*this)) > route_key(route_bits(other));
+}
@@ -1,210 +1,447 @@
 #include "as_graph.h"
-#include <bzlib.h>
+#include "bz2_blocks.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <numeric>
+#include <utility>
 #include <fstream>
 #include <iostream>
-#include <stack>
-#include <queue>
 #include <string_view>
 #include <charconv>
+#include <algorithm>
+
+void Adjacency::assign(std::vector<uint32_t>&& offsets, std::vector<uint32_t>&& targets) {
+    owned_offsets = std::move(offsets);
+    owned_targets = std::move(targets);
+    offsets_ptr = owned_offsets.data();
+    targets_ptr = owned_targets.data();
+}
+
+void Adjacency::view(const uint32_t* offsets, const uint32_t* targets) {
+    owned_offsets.clear();
+    owned_targets.clear();
+    offsets_ptr = offsets;
+    targets_ptr = targets;
+}
+
+// Builds CSR lists from (from, to) edges with a counting sort; neighbors keep
+// the order in which their edges appear
+static void build_adjacency(Adjacency& adj, std::size_t num_nodes,
+                            const std::vector<std::pair<uint32_t, uint32_t>>& edges) {
+    std::vector<uint32_t> offsets(num_nodes + 1, 0);
+    for (const auto& e : edges) ++offsets[e.first + 1];
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<uint32_t> targets(edges.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (const auto& e : edges) targets[fill[e.first]++] = e.second;
+    adj.assign(std::move(offsets), std::move(targets));
+}
+
+// One parsed relationship line, before ASNs are mapped to node indices
+struct RawEdge {
+    ASN asn1;
+    ASN asn2;
+    int type;
+};
+
+static std::string_view trim(std::string_view v) {
+    auto start = v.find_first_not_of(" \t\r\n");
+    if (start == std::string_view::npos) return std::string_view();
+    auto end = v.find_last_not_of(" \t\r\n");
+    return v.substr(start, end - start + 1);
+}
+
+// Expected format: ASN1|ASN2|type[|source]; false for comments and malformed lines
+static bool parse_relationship(std::string_view v, RawEdge& e) {
+    v = trim(v);
+    if (v.empty() || v[0] == '#') return false;
+
+    size_t first_sep = v.find('|');
+    if (first_sep == std::string_view::npos) return false;
+    size_t second_sep = v.find('|', first_sep + 1);
+    if (second_sep == std::string_view::npos) return false;
+
+    std::string_view asn1_view = trim(v.substr(0, first_sep));
+    std::string_view asn2_view = trim(v.substr(first_sep + 1, second_sep - first_sep - 1));
+    std::string_view type_view = trim(v.substr(second_sep + 1));
+    if (asn1_view.empty() || asn2_view.empty() || type_view.empty()) return false;
+
+    auto res1 = std::from_chars(asn1_view.data(), asn1_view.data() + asn1_view.size(), e.asn1);
+    if (res1.ec != std::errc()) return false;
+    auto res2 = std::from_chars(asn2_view.data(), asn2_view.data() + asn2_view.size(), e.asn2);
+    if (res2.ec != std::errc()) return false;
+    auto res3 = std::from_chars(type_view.data(), type_view.data() + type_view.size(), e.type);
+    return res3.ec == std::errc();
+}
+
+// Calls fn for every complete line in text[begin, end); the range must end
+// right after a newline
+template <typename Func>
+static void for_each_line(const char* begin, const char* end, Func&& fn) {
+    while (begin < end) {
+        const char* nl = static_cast<const char*>(std::memchr(begin, '\n', static_cast<size_t>(end - begin)));
+        fn(std::string_view(begin, static_cast<size_t>(nl - begin)));
+        begin = nl + 1;
+    }
+}
+
+// Result of parsing one independently decoded piece of the file. Lines cut by
+// the piece boundaries are kept as text and stitched together in file order.
+struct ParsedPiece {
+    std::string head;  // text before the first newline
+    std::string tail;  // text after the last newline
+    bool has_newline = false;
+    std::vector<RawEdge> edges;
+};
+
+static void parse_piece(std::string_view text, ParsedPiece& piece) {
+    size_t first_nl = text.find('\n');
+    if (first_nl == std::string_view::npos) {
+        piece.head.assign(text);
+        return;
+    }
+    size_t last_nl = text.rfind('\n');
+    piece.has_newline = true;
+    piece.head.assign(text.substr(0, first_nl));
+    piece.tail.assign(text.substr(last_nl + 1));
+    piece.edges.reserve((last_nl - first_nl) / 16);
+    for_each_line(text.data() + first_nl + 1, text.data() + last_nl + 1, [&](std::string_view line) {
+        RawEdge e;
+        if (parse_relationship(line, e)) piece.edges.push_back(e);
+    });
+}
+
+// Reads the whole compressed file; the bz2 image is small next to the decoded text
+static bool read_file(const std::string& path, std::vector<unsigned char>& data) {
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) return false;
+    data.clear();
+    unsigned char buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) data.insert(data.end(), buf, buf + n);
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+// Decompressed text is handed from the decoder thread to the parser in chunks
+// of this size; a few chunks in flight keep both sides busy
+static constexpr size_t kLoaderChunkSize = 4u << 20;
+static constexpr size_t kLoaderChunksInFlight = 4;
 
 // Loads CAIDA AS relationships from a compressed bz2 file
 // File format: ASN1 ASN2 | type (P2C=0 C2P=-1 P2P=1), ignores the source column
-// Reads the file as a stream to keep memory usage low
-bool ASGraph::load_from_caida(const std::string& bz2_path) {
-    // Open the bz2 file for reading
-    FILE* fp = fopen(bz2_path.c_str(), "rb");
-    if (!fp) {
+// With a multi-threaded pool the bz2 blocks are decoded and parsed in parallel;
+// otherwise one thread decodes while the calling thread parses. Nodes are
+// numbered in file order either way, so the graph does not depend on threads.
+bool ASGraph::load_from_caida(const std::string& bz2_path, ThreadPool* pool) {
+    std::vector<unsigned char> compressed;
+    if (!read_file(bz2_path, compressed)) {
         std::cerr << "Failed to open file: " << bz2_path << std::endl;
         return false;
     }
 
     nodes.clear();
     asn_to_index.clear();
+    storage.reset();
 
-    int bzerr = BZ_OK;
-    BZFILE* bzf = BZ2_bzReadOpen(&bzerr, fp, /*verbosity*/0, /*small*/0, nullptr, 0);
-    if (!bzf || bzerr != BZ_OK) {
-        std::cerr << "Error opening bz2 file" << std::endl;
-        if (bzf) {
-            BZ2_bzReadClose(&bzerr, bzf);
-        }
-        fclose(fp);
-        return false;
-    }
-
-    char buf[8192];
     size_t total_lines = 0;
-    std::string leftover;
+
+    // Edges are collected as (from, to) index pairs and turned into CSR lists at the end
+    std::vector<std::pair<uint32_t, uint32_t>> provider_edges;  // (customer, provider)
+    std::vector<std::pair<uint32_t, uint32_t>> customer_edges;  // (provider, customer)
+    std::vector<std::pair<uint32_t, uint32_t>> peer_edges;      // both directions
 
     auto get_index = [this](ASN asn) -> uint32_t {
         auto it = asn_to_index.find(asn);
         if (it != asn_to_index.end()) return it->second;
         uint32_t idx = static_cast<uint32_t>(nodes.size());
         nodes.emplace_back();
-        ASNode& n = nodes.back();
-        n.asn = asn;
-        n.providers.reserve(8);
-        n.customers.reserve(8);
-        n.peers.reserve(8);
+        nodes.back().asn = asn;
         asn_to_index.emplace(asn, idx);
         return idx;
     };
 
-    auto trim = [](std::string_view v) {
-        auto start = v.find_first_not_of(" \t\r\n");
-        if (start == std::string_view::npos) return std::string_view();
-        auto end = v.find_last_not_of(" \t\r\n");
-        return v.substr(start, end - start + 1);
-    };
+    auto add_edge = [&](const RawEdge& e) {
+        uint32_t idx1 = get_index(e.asn1);
+        uint32_t idx2 = get_index(e.asn2);
 
-    auto parse_line = [&](std::string_view v) {
-        v = trim(v);
-        if (v.empty() || v[0] == '#') return;
-
-        // Expected format: ASN1|ASN2|type (type: 0, -1, 1)
-        size_t first_sep = v.find('|');
-        if (first_sep == std::string_view::npos) return;
-        size_t second_sep = v.find('|', first_sep + 1);
-        if (second_sep == std::string_view::npos) return;
-
-        std::string_view asn1_view = trim(v.substr(0, first_sep));
-        std::string_view asn2_view = trim(v.substr(first_sep + 1, second_sep - first_sep - 1));
-        std::string_view type_view = trim(v.substr(second_sep + 1));
-        if (asn1_view.empty() || asn2_view.empty() || type_view.empty()) return;
-
-        ASN asn1 = 0;
-        ASN asn2 = 0;
-        int type = 0;
-
-        auto res1 = std::from_chars(asn1_view.data(), asn1_view.data() + asn1_view.size(), asn1);
-        if (res1.ec != std::errc()) return;
-        auto res2 = std::from_chars(asn2_view.data(), asn2_view.data() + asn2_view.size(), asn2);
-        if (res2.ec != std::errc()) return;
-        auto res3 = std::from_chars(type_view.data(), type_view.data() + type_view.size(), type);
-        if (res3.ec != std::errc()) return;
-
-        uint32_t idx1 = get_index(asn1);
-        uint32_t idx2 = get_index(asn2);
-        ASNode& n1 = nodes[idx1];
-        ASNode& n2 = nodes[idx2];
-
-        if (type == P2C) {
-            n1.customers.emplace_back(idx2);
-            n2.providers.emplace_back(idx1);
-        } else if (type == C2P) {
-            n2.customers.emplace_back(idx1);
-            n1.providers.emplace_back(idx2);
-        } else if (type == P2P) {
-            n1.peers.emplace_back(idx2);
-            n2.peers.emplace_back(idx1);
+        if (e.type == P2C) {
+            customer_edges.emplace_back(idx1, idx2);
+            provider_edges.emplace_back(idx2, idx1);
+        } else if (e.type == C2P) {
+            customer_edges.emplace_back(idx2, idx1);
+            provider_edges.emplace_back(idx1, idx2);
+        } else if (e.type == P2P) {
+            peer_edges.emplace_back(idx1, idx2);
+            peer_edges.emplace_back(idx2, idx1);
         }
         ++total_lines;
     };
 
-    while (true) {
-        int nread = BZ2_bzRead(&bzerr, bzf, buf, static_cast<int>(sizeof(buf)));
-        if (bzerr != BZ_OK && bzerr != BZ_STREAM_END) {
-            std::cerr << "Error reading bz2 file" << std::endl;
-            BZ2_bzReadClose(&bzerr, bzf);
-            fclose(fp);
-            return false;
+    auto add_line = [&](std::string_view line) {
+        RawEdge e;
+        if (parse_relationship(line, e)) add_edge(e);
+    };
+
+    // Parallel path: every bz2 block is decoded and parsed on its own, then the
+    // pieces are merged in file order
+    bool loaded = false;
+    std::vector<Bz2Block> blocks;
+    if (pool && pool->size() > 1 &&
+        find_bz2_blocks(compressed.data(), compressed.size(), blocks) && blocks.size() > 1) {
+        std::vector<ParsedPiece> pieces(blocks.size());
+        std::atomic<bool> failed{false};
+        pool->parallel_for(blocks.size(), [&](std::size_t i) {
+            return blocks[i].bit_end - blocks[i].bit_begin;
+        }, [&](std::size_t i) {
+            std::string text;
+            if (!decompress_bz2_block(compressed.data(), blocks[i], text)) {
+                failed.store(true, std::memory_order_relaxed);
+                return;
+            }
+            parse_piece(text, pieces[i]);
+        });
+
+        if (!failed.load()) {
+            std::string carry;  // line cut by piece boundaries
+            for (ParsedPiece& piece : pieces) {
+                carry += piece.head;
+                if (!piece.has_newline) continue;
+                add_line(carry);
+                for (const RawEdge& e : piece.edges) add_edge(e);
+                carry = std::move(piece.tail);
+                piece = ParsedPiece();
+            }
+            add_line(carry);
+            loaded = true;
+        } else {
+            // Should not happen for a valid file; the sequential decoder reports the error
+            nodes.clear();
+            asn_to_index.clear();
         }
-        
-        if (nread > 0) {
-            std::string chunk = leftover + std::string(buf, nread);
-            leftover.clear();
-            
-            size_t pos = 0;
-            while (pos < chunk.size()) {
-                size_t nl = chunk.find('\n', pos);
-                if (nl == std::string::npos) {
-                    leftover = chunk.substr(pos);
+    }
+
+    if (!loaded) {
+        // Sequential path: parse each decoded chunk in place; only a line cut by
+        // the chunk boundary is copied
+        std::string carry;
+        auto consume = [&](const char* data, size_t len) {
+            const char* end = data + len;
+            const char* first_nl = static_cast<const char*>(std::memchr(data, '\n', len));
+            if (!first_nl) {
+                carry.append(data, len);
+                return;
+            }
+            carry.append(data, first_nl);
+            add_line(carry);
+            const char* last_nl = first_nl;
+            for (const char* p = end; p > first_nl; --p) {
+                if (p[-1] == '\n') {
+                    last_nl = p - 1;
                     break;
                 }
+            }
+            for_each_line(first_nl + 1, last_nl + 1, add_line);
+            carry.assign(last_nl + 1, end);
+        };
 
-                std::size_t len = nl - pos;
-                parse_line(std::string_view(chunk.data() + pos, len));
-                pos = nl + 1;
+        bool ok = true;
+        if (pool && pool->size() > 1) {
+            // Decoder thread -> bounded queue of chunks -> parser (this thread)
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::deque<std::vector<char>> full;
+            std::vector<std::vector<char>> free_chunks;
+            bool done = false;
+            bool decode_ok = true;
+            std::thread decoder([&] {
+                bool r = decompress_bz2_stream(compressed.data(), compressed.size(), kLoaderChunkSize,
+                                               [&](const char* data, size_t len) {
+                    std::vector<char> chunk;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        cv.wait(lock, [&] { return full.size() < kLoaderChunksInFlight; });
+                        if (!free_chunks.empty()) {
+                            chunk = std::move(free_chunks.back());
+                            free_chunks.pop_back();
+                        }
+                    }
+                    chunk.assign(data, data + len);
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        full.push_back(std::move(chunk));
+                    }
+                    cv.notify_all();
+                });
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    decode_ok = r;
+                    done = true;
+                }
+                cv.notify_all();
+            });
+            while (true) {
+                std::vector<char> chunk;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&] { return !full.empty() || done; });
+                    if (full.empty()) break;
+                    chunk = std::move(full.front());
+                    full.pop_front();
+                }
+                cv.notify_all();
+                consume(chunk.data(), chunk.size());
+                std::lock_guard<std::mutex> lock(mutex);
+                free_chunks.push_back(std::move(chunk));
             }
+            decoder.join();
+            ok = decode_ok;
+        } else {
+            ok = decompress_bz2_stream(compressed.data(), compressed.size(), kLoaderChunkSize, consume);
         }
-        
-        if (bzerr == BZ_STREAM_END) {
-            if (!leftover.empty() && leftover[0] != '#') {
-                parse_line(std::string_view(leftover.data(), leftover.size()));
-            }
-            break;
+        if (!ok) {
+            std::cerr << "Error reading bz2 file" << std::endl;
+            return false;
         }
+        add_line(carry);
     }
 
-    BZ2_bzReadClose(&bzerr, bzf);
-    fclose(fp);
+    build_adjacency(providers, nodes.size(), provider_edges);
+    build_adjacency(customers, nodes.size(), customer_edges);
+    build_adjacency(peers, nodes.size(), peer_edges);
     std::cerr << "Loaded: " << nodes.size() << " nodes, " << total_lines << " relationships" << std::endl;
     return true;
 }
 
-bool ASGraph::detect_cycles() {
-    // DFS for cycles in provider/customer relationships (ignore peers)
-    std::vector<int> visit(nodes.size(), 0);
-    for (uint32_t idx = 0; idx < nodes.size(); ++idx) {
-        if (visit[idx] == 0) {
-            if (has_cycle(idx, visit)) return true;
+bool ASGraph::rank_topology(std::vector<std::vector<uint32_t>>& ranks, ThreadPool* pool,
+                            std::vector<ASN>* cycle) {
+    // Level-synchronous Kahn over provider edges: level 0 are the ASes without
+    // customers, an AS joins level r + 1 when its last customer is released in
+    // level r. That level is its longest customer chain, so every provider sits
+    // strictly above each of its customers.
+    const uint32_t n = static_cast<uint32_t>(nodes.size());
+    std::unique_ptr<std::atomic<uint32_t>[]> pending(new std::atomic<uint32_t>[n]);
+    // Released nodes in level order; level r is order[level_begin[r], level_begin[r + 1])
+    std::vector<uint32_t> order(n);
+    std::atomic<uint32_t> released{0};
+    std::vector<uint32_t> level_begin{0};
+
+    uint32_t tail = 0;
+    for (uint32_t idx = 0; idx < n; ++idx) {
+        uint32_t deg = customers.degree(idx);
+        pending[idx].store(deg, std::memory_order_relaxed);
+        if (deg == 0) order[tail++] = idx;
+    }
+    released.store(tail, std::memory_order_relaxed);
+
+    ThreadPool serial(1);
+    ThreadPool& workers = pool ? *pool : serial;
+    uint32_t begin = 0;
+    while (begin < tail) {
+        level_begin.push_back(tail);
+        const uint32_t end = tail;
+        workers.parallel_for(end - begin, [&](std::size_t i) {
+            return 1 + providers.degree(order[begin + i]);
+        }, [&](std::size_t i) {
+            for (uint32_t prov_idx : providers[order[begin + i]]) {
+                if (pending[prov_idx].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    order[released.fetch_add(1, std::memory_order_relaxed)] = prov_idx;
+                }
+            }
+        });
+        begin = end;
+        tail = released.load(std::memory_order_relaxed);
+        // Release order within a level depends on the threads; index order does not
+        std::sort(order.begin() + begin, order.begin() + tail);
+    }
+
+    if (tail < n) {
+        // Every unreleased AS still waits on an unreleased customer, so walking
+        // such customers from any unreleased AS must run into a cycle
+        if (cycle) {
+            cycle->clear();
+            std::vector<uint32_t> seen_at(n, UINT32_MAX);
+            std::vector<uint32_t> walk;
+            uint32_t u = 0;
+            while (pending[u].load(std::memory_order_relaxed) == 0) ++u;
+            while (seen_at[u] == UINT32_MAX) {
+                seen_at[u] = static_cast<uint32_t>(walk.size());
+                walk.push_back(u);
+                for (uint32_t cust_idx : customers[u]) {
+                    if (pending[cust_idx].load(std::memory_order_relaxed) != 0) {
+                        u = cust_idx;
+                        break;
+                    }
+                }
+            }
+            // Walked provider -> customer; report the cycle from customer to provider
+            for (std::size_t i = walk.size(); i-- > seen_at[u];) cycle->push_back(nodes[walk[i]].asn);
         }
+        return false;
     }
-    return false;
-}
 
-bool ASGraph::has_cycle(uint32_t index, std::vector<int>& visit) {
-    visit[index] = 1;
-    ASNode& node = nodes[index];
-    for (uint32_t prov_idx : node.providers) {
-        if (visit[prov_idx] == 1) return true;
-        if (visit[prov_idx] == 0 && has_cycle(prov_idx, visit)) return true;
+    ranks.assign(level_begin.size() - 1, {});
+    for (std::size_t r = 0; r + 1 < level_begin.size(); ++r) {
+        ranks[r].assign(order.begin() + level_begin[r], order.begin() + level_begin[r + 1]);
+        for (uint32_t idx : ranks[r]) nodes[idx].rank = static_cast<int>(r);
     }
-    visit[index] = 2;
-    return false;
+    return true;
 }
 
-std::vector<std::vector<uint32_t>> ASGraph::flatten_ranks() {
-    std::vector<int> rank(nodes.size(), -1);
-    std::queue<uint32_t> q;
-    for (uint32_t idx = 0; idx < nodes.size(); ++idx) {
-        if (nodes[idx].customers.empty()) {
-            rank[idx] = 0;
-            nodes[idx].rank = 0;
-            q.push(idx);
+void ASGraph::renumber_by_rank(std::vector<std::vector<uint32_t>>& ranks) {
+    const std::size_t n = nodes.size();
+    if (n == 0) return;
+    constexpr uint32_t kUnassigned = UINT32_MAX;
+    std::vector<uint32_t> new_index(n, kUnassigned);
+    std::vector<uint32_t> order;
+    order.reserve(n);
+    for (const auto& rank : ranks) {
+        for (uint32_t idx : rank) {
+            new_index[idx] = static_cast<uint32_t>(order.size());
+            order.push_back(idx);
         }
     }
-    int cur_rank = 0;
-    while (!q.empty()) {
-        int sz = static_cast<int>(q.size());
-        for (int i = 0; i < sz; ++i) {
-            uint32_t u = q.front();
-            q.pop();
-            for (uint32_t prov_idx : nodes[u].providers) {
-                if (rank[prov_idx] == -1) {
-                    int r = cur_rank + 1;
-                    rank[prov_idx] = r;
-                    nodes[prov_idx].rank = r;
-                    q.push(prov_idx);
-                }
-            }
+    // Unranked nodes (only possible on cyclic input) go last
+    for (uint32_t idx = 0; idx < n; ++idx) {
+        if (new_index[idx] == kUnassigned) {
+            new_index[idx] = static_cast<uint32_t>(order.size());
+            order.push_back(idx);
         }
-        ++cur_rank;
     }
-    int max_rank = -1;
-    for (int r : rank) {
-        if (r > max_rank) max_rank = r;
+
+    std::vector<ASNode> renumbered(n);
+    for (uint32_t i = 0; i < n; ++i) {
+        renumbered[i] = nodes[order[i]];
+        asn_to_index[renumbered[i].asn] = i;
     }
-    std::vector<std::vector<uint32_t>> ranks;
-    if (max_rank >= 0) {
-        ranks.resize(static_cast<std::size_t>(max_rank + 1));
-        for (uint32_t idx = 0; idx < nodes.size(); ++idx) {
-            if (rank[idx] >= 0) {
-                ranks[static_cast<std::size_t>(rank[idx])].push_back(idx);
-            }
+    nodes = std::move(renumbered);
+
+    for (Adjacency* adj : {&providers, &customers, &peers}) {
+        std::vector<uint32_t> offsets(n + 1, 0);
+        std::vector<uint32_t> targets;
+        targets.reserve(adj->offsets()[n]);
+        for (uint32_t i = 0; i < n; ++i) {
+            auto list = (*adj)[order[i]];
+            std::size_t begin = targets.size();
+            for (uint32_t t : list) targets.push_back(new_index[t]);
+            std::sort(targets.begin() + begin, targets.end());
+            offsets[i + 1] = static_cast<uint32_t>(targets.size());
         }
+        adj->assign(std::move(offsets), std::move(targets));
+    }
+    storage.reset();
+
+    uint32_t next = 0;
+    for (auto& rank : ranks) {
+        std::iota(rank.begin(), rank.end(), next);
+        next += static_cast<uint32_t>(rank.size());
     }
-    return ranks;
 }
 
 ASNode* ASGraph::get_node_by_asn(ASN asn) {
@@ -1,5 +1,6 @@
 // ASGraph - graph of AS relationships from CAIDA data
-// Loads bz2 file, creates nodes with providers/customers/peers, cycle detection and rank flattening for propagation
+// Loads bz2 file, stores providers/customers/peers as CSR adjacency, combined cycle check and ranking
+// and rank-ordered renumbering for propagation
 #pragma once
 
 #include <unordered_map>
@@ -7,33 +8,71 @@
 #include <string>
 #include <cstdint>
 #include <memory>
+#include <span>
+
+class ThreadPool;
 
 typedef uint32_t ASN;
 
 enum RelType { P2C = 0, C2P = -1, P2P = 1 };
 
-struct BGPState;
-
 struct ASNode {
     ASN asn = 0;
-    std::vector<uint32_t> providers;   // indices of provider ASNs
-    std::vector<uint32_t> customers;   // indices of customer ASNs
-    std::vector<uint32_t> peers;       // indices of peer ASNs
-    BGPState* state = nullptr;         // pointer into per-AS BGP state
     int rank = -1;
 };
 
+// Compressed-sparse-row neighbor lists: the neighbors of node i are
+// targets[offsets[i] .. offsets[i + 1]). The arrays either live in the owned
+// vectors or in memory owned elsewhere (a mapped graph snapshot).
+class Adjacency {
+public:
+    Adjacency() = default;
+    Adjacency(const Adjacency&) = delete;
+    Adjacency& operator=(const Adjacency&) = delete;
+    Adjacency(Adjacency&&) = default;
+    Adjacency& operator=(Adjacency&&) = default;
+
+    std::span<const uint32_t> operator[](uint32_t idx) const {
+        return {targets_ptr + offsets_ptr[idx], targets_ptr + offsets_ptr[idx + 1]};
+    }
+    uint32_t degree(uint32_t idx) const { return offsets_ptr[idx + 1] - offsets_ptr[idx]; }
+
+    // Takes ownership of freshly built arrays (offsets has num_nodes + 1 entries)
+    void assign(std::vector<uint32_t>&& offsets, std::vector<uint32_t>&& targets);
+    // Points at arrays owned elsewhere; they must outlive this object
+    void view(const uint32_t* offsets, const uint32_t* targets);
+
+    const uint32_t* offsets() const { return offsets_ptr; }
+    const uint32_t* targets() const { return targets_ptr; }
+
+private:
+    std::vector<uint32_t> owned_offsets;
+    std::vector<uint32_t> owned_targets;
+    const uint32_t* offsets_ptr = nullptr;
+    const uint32_t* targets_ptr = nullptr;
+};
+
 class ASGraph {
 public:
     std::vector<ASNode> nodes;                     // index-based storage
     std::unordered_map<ASN, uint32_t> asn_to_index;  // maps ASN -> node index
-    bool load_from_caida(const std::string& bz2_path);
-    bool detect_cycles();
-    std::vector<std::vector<uint32_t>> flatten_ranks();
+    Adjacency providers;                           // indices of provider ASes per node
+    Adjacency customers;                           // indices of customer ASes per node
+    Adjacency peers;                               // indices of peer ASes per node
+    std::shared_ptr<const void> storage;           // keeps external adjacency arrays (snapshot mapping) alive
+
+    // Decodes and parses on the pool's threads when it has more than one
+    bool load_from_caida(const std::string& bz2_path, ThreadPool* pool = nullptr);
+    // One pass for cycle check and ranking: rank = longest customer chain below
+    // the AS, ranks[r] lists rank r in index order. Runs level by level on the
+    // pool when given. Returns false on a provider/customer cycle and, if cycle
+    // is set, stores the ASNs of one such cycle (each AS a customer of the next).
+    bool rank_topology(std::vector<std::vector<uint32_t>>& ranks, ThreadPool* pool = nullptr,
+                       std::vector<ASN>* cycle = nullptr);
+    // Renumbers nodes so every rank occupies a contiguous index range (rank 0
+    // first) and neighbor lists are sorted; rewrites ranks to the new indices
+    void renumber_by_rank(std::vector<std::vector<uint32_t>>& ranks);
 
     ASNode* get_node_by_asn(ASN asn);
     const ASNode* get_node_by_asn(ASN asn) const;
-
-private:
-    bool has_cycle(uint32_t index, std::vector<int>& visit);
-};
\ No newline at end of file
+};
@@ -1,33 +1,237 @@
 #include "bgp.h"
 #include <algorithm>
 #include <utility>
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+void BGPTable::init(std::vector<BGPState>& states, std::size_t num_prefixes) {
+  const std::size_t words = (num_prefixes + 63) / 64;
+  std::size_t rows = 0;
+  for (const BGPState& st : states) rows += st.is_stub() ? 0 : 1;
+  const std::size_t slots = rows * num_prefixes;
+  const std::size_t bits = (rows + 1) * words;  // + the empty row of collapsed stubs
+  arena.reset(2 * slots * sizeof(Announcement) + 2 * bits * sizeof(uint64_t) + 64);
+  Announcement* rib_slots = arena.allocate<Announcement>(slots);
+  Announcement* queue_slots = arena.allocate<Announcement>(slots);
+  uint64_t* rib_bits = arena.allocate<uint64_t>(bits);
+  uint64_t* queue_bits = arena.allocate<uint64_t>(bits);
+  std::fill_n(rib_bits, bits, uint64_t{0});
+  std::fill_n(queue_bits, bits, uint64_t{0});
+  uint64_t* empty_bits = rib_bits + rows * words;  // never written
+  std::size_t row = 0;
+  for (BGPState& st : states) {
+    st.prefix_words = static_cast<uint32_t>(words);
+    st.num_routes = 0;
+    if (st.is_stub()) {
+      st.rib = nullptr;
+      st.recv_queue = nullptr;
+      st.rib_present = empty_bits;
+      st.queue_present = empty_bits;
+      continue;
+    }
+    st.rib = rib_slots + row * num_prefixes;
+    st.recv_queue = queue_slots + row * num_prefixes;
+    st.rib_present = rib_bits + row * words;
+    st.queue_present = queue_bits + row * words;
+    ++row;
+  }
+}
+
+static inline void store_route(BGPState& state, PrefixID prefix_id, const Announcement& ann) {
+  uint64_t& word = state.rib_present[prefix_id >> 6];
+  const uint64_t bit = uint64_t{1} << (prefix_id & 63);
+  state.num_routes += (word & bit) ? 0 : 1;
+  word |= bit;
+  state.rib[prefix_id] = ann;
+}
+
+void bgp_originate(BGPState& state, PrefixID prefix_id, const Announcement& ann) {
+  store_route(state, prefix_id, ann);
+}
 
 // Enqueue a received announcement into the per-prefix queue.
-// If ROV is enabled, drop announcements marked as rov_invalid.
-void bgp_receive(BGPState& state, PrefixID prefix_id, const Announcement& ann) {
-  if (state.is_rov && ann.rov_invalid) {
-    return;
-  }
-  auto it = state.recv_queue.find(prefix_id);
-  if (it == state.recv_queue.end()) {
-    state.recv_queue.emplace(prefix_id, ann);
-  } else {
+// If ROV is enabled (in the slot's lane), drop announcements marked as rov_invalid.
+ReceiveOutcome bgp_receive(BGPState& state, PrefixID prefix_id, const Announcement& ann) {
+  if ((state.policy & POLICY_ROV) && ann.rov_invalid && ((state.rov_lanes >> (prefix_id & 63)) & 1)) {
+    return RECV_DROPPED_ROV;
+  }
+  uint64_t& word = state.queue_present[prefix_id >> 6];
+  const uint64_t bit = uint64_t{1} << (prefix_id & 63);
+  if (!(word & bit)) {
+    word |= bit;
+    state.recv_queue[prefix_id] = ann;
+    return RECV_QUEUED;
+  } else if (ann > state.recv_queue[prefix_id]) {
     // Keep only the best candidate per prefix according to operator>
-    if (ann > it->second) {
-      it->second = ann;
+    state.recv_queue[prefix_id] = ann;
+    return RECV_REPLACED;
+  }
+  return RECV_KEPT;
+}
+
+namespace {
+
+// Bits of the sender's entry a receiver keeps (path_len, rov_invalid); next_hop
+// and rel are replaced by the stamp of the link the route arrives over
+constexpr uint64_t kKeepBits = 0xFF00FFFF00000000ull;
+constexpr uint64_t kRovBits = 0xFF00000000000000ull;
+constexpr uint64_t kKeyFlip = 0x0000FFFFFFFFFFFFull;  // see route_key
+constexpr uint64_t kKeyMask = 0x00FFFFFFFFFFFFFFull;
+
+struct MergeCounts {
+  uint64_t replaced = 0;
+  uint64_t dropped = 0;
+  uint64_t rejected = 0;
+};
+
+// Merges the routes of one bitmap word (offered: sender's present bits) into
+// 64 queue slots; returns the new queue presence word. With kRov, ROV-invalid
+// routes are dropped in the slots set in rov_lanes.
+#if defined(__AVX512F__)
+template <bool kRov>
+inline uint64_t merge_word(Announcement* queue, uint64_t queue_word, const Announcement* rib, uint64_t offered,
+                           uint64_t stamp, uint64_t rov_lanes, MergeCounts& counts) {
+  const __m512i keep = _mm512_set1_epi64(static_cast<long long>(kKeepBits));
+  const __m512i stamp_v = _mm512_set1_epi64(static_cast<long long>(stamp));
+  const __m512i rov = _mm512_set1_epi64(static_cast<long long>(kRovBits));
+  const __m512i flip = _mm512_set1_epi64(static_cast<long long>(kKeyFlip));
+  const __m512i key_mask = _mm512_set1_epi64(static_cast<long long>(kKeyMask));
+  for (unsigned j = 0; j < 64; j += 8) {
+    __mmask8 in = static_cast<__mmask8>(offered >> j);
+    if (!in) continue;
+    const __m512i cand = _mm512_or_si512(_mm512_and_si512(_mm512_maskz_loadu_epi64(in, rib + j), keep), stamp_v);
+    if constexpr (kRov) {
+      const __mmask8 invalid = _mm512_mask_test_epi64_mask(static_cast<__mmask8>(in & (rov_lanes >> j)), cand, rov);
+      counts.dropped += std::popcount(static_cast<unsigned>(invalid));
+      in &= static_cast<__mmask8>(~invalid);
     }
+    const __mmask8 queued = static_cast<__mmask8>(queue_word >> j) & in;
+    const __m512i held = _mm512_maskz_loadu_epi64(queued, queue + j);
+    const __m512i cand_key = _mm512_and_si512(_mm512_xor_si512(cand, flip), key_mask);
+    const __m512i held_key = _mm512_and_si512(_mm512_xor_si512(held, flip), key_mask);
+    const __mmask8 better = _mm512_mask_cmpgt_epu64_mask(queued, cand_key, held_key);
+    _mm512_mask_storeu_epi64(queue + j, static_cast<__mmask8>((in & ~queued) | better), cand);
+    counts.replaced += std::popcount(static_cast<unsigned>(better));
+    queue_word |= uint64_t{in} << j;
   }
+  return queue_word;
+}
+#elif defined(__AVX2__)
+// Lane mask (all ones / zero per 64-bit lane) from the low 4 bits of m
+inline __m256i lane_mask(uint64_t m) {
+  const __m256i bits = _mm256_set_epi64x(8, 4, 2, 1);
+  return _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(static_cast<long long>(m & 15)), bits), bits);
 }
 
-// Processes the receive queue for each prefix:
-// Selects the best announcement according to priority
-// (relationship > shortest path > lowest next_hop) and updates the local RIB.
-void bgp_process_queue(BGPState& state, ASN self_asn) {
-  for (auto& [prefix_id, best] : state.recv_queue) {
-    if (best.as_path.empty() || best.as_path.front() != self_asn) {
-      best.as_path.insert(best.as_path.begin(), self_asn);
+inline unsigned lane_bits(__m256i v) { return static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(v))); }
+
+template <bool kRov>
+inline uint64_t merge_word(Announcement* queue, uint64_t queue_word, const Announcement* rib, uint64_t offered,
+                           uint64_t stamp, uint64_t rov_lanes, MergeCounts& counts) {
+  const __m256i keep = _mm256_set1_epi64x(static_cast<long long>(kKeepBits));
+  const __m256i stamp_v = _mm256_set1_epi64x(static_cast<long long>(stamp));
+  const __m256i rov = _mm256_set1_epi64x(static_cast<long long>(kRovBits));
+  const __m256i flip = _mm256_set1_epi64x(static_cast<long long>(kKeyFlip));
+  const __m256i key_mask = _mm256_set1_epi64x(static_cast<long long>(kKeyMask));
+  const __m256i zero = _mm256_setzero_si256();
+  for (unsigned j = 0; j < 64; j += 4) {
+    uint64_t in = (offered >> j) & 15;
+    if (!in) continue;
+    const __m256i in_v = lane_mask(in);
+    const __m256i loaded = _mm256_maskload_epi64(reinterpret_cast<const long long*>(rib + j), in_v);
+    const __m256i cand = _mm256_or_si256(_mm256_and_si256(loaded, keep), stamp_v);
+    if constexpr (kRov) {
+      const unsigned invalid = lane_bits(_mm256_andnot_si256(_mm256_cmpeq_epi64(_mm256_and_si256(cand, rov), zero), in_v)) &
+                               in & (rov_lanes >> j);
+      counts.dropped += std::popcount(invalid);
+      in &= ~uint64_t{invalid};
+    }
+    const uint64_t queued = (queue_word >> j) & in;
+    const __m256i held = _mm256_maskload_epi64(reinterpret_cast<const long long*>(queue + j), lane_mask(queued));
+    // Keys stay below 2^56, so the signed compare orders them correctly
+    const __m256i cand_key = _mm256_and_si256(_mm256_xor_si256(cand, flip), key_mask);
+    const __m256i held_key = _mm256_and_si256(_mm256_xor_si256(held, flip), key_mask);
+    const uint64_t better = lane_bits(_mm256_cmpgt_epi64(cand_key, held_key)) & queued;
+    _mm256_maskstore_epi64(reinterpret_cast<long long*>(queue + j), lane_mask((in & ~queued) | better), cand);
+    counts.replaced += std::popcount(better);
+    queue_word |= in << j;
+  }
+  return queue_word;
+}
+#else
+template <bool kRov>
+inline uint64_t merge_word(Announcement* queue, uint64_t queue_word, const Announcement* rib, uint64_t offered,
+                           uint64_t stamp, uint64_t rov_lanes, MergeCounts& counts) {
+  while (offered) {
+    const unsigned i = static_cast<unsigned>(std::countr_zero(offered));
+    offered &= offered - 1;
+    const uint64_t cand = (route_bits(rib[i]) & kKeepBits) | stamp;
+    if (kRov && (cand & kRovBits) && ((rov_lanes >> i) & 1)) {
+      ++counts.dropped;
+      continue;
+    }
+    const uint64_t bit = uint64_t{1} << i;
+    if (!(queue_word & bit)) {
+      queue_word |= bit;
+    } else if (route_key(cand) > route_key(route_bits(queue[i]))) {
+      ++counts.replaced;
+    } else {
+      continue;
     }
-    state.rib[prefix_id] = std::move(best);
+    std::memcpy(&queue[i], &cand, sizeof(cand));
   }
-  state.recv_queue.clear();
-}
\ No newline at end of file
+  return queue_word;
+}
+#endif
+
+}  // namespace
+
+template <bool kRov>
+void bgp_receive_rib(BGPState& state, const BGPState& from, ASN from_asn, Rel rel, const uint64_t* reject,
+                     RouteCounters* counters) {
+  const uint64_t stamp = (uint64_t{rel} << 48) | from_asn;
+  MergeCounts counts;
+  uint64_t offered_total = 0;
+  for (uint32_t w = 0; w < from.prefix_words; ++w) {
+    uint64_t offered = from.rib_present[w];
+    if (!offered) continue;
+    offered_total += static_cast<uint64_t>(std::popcount(offered));
+    if (reject) {
+      counts.rejected += static_cast<uint64_t>(std::popcount(offered & reject[w]));
+      offered &= ~reject[w];
+      if (!offered) continue;
+    }
+    state.queue_present[w] = merge_word<kRov>(state.recv_queue + (std::size_t{w} << 6), state.queue_present[w],
+                                              from.rib + (std::size_t{w} << 6), offered, stamp, state.rov_lanes,
+                                              counts);
+  }
+  if (counters) {
+    counters->received += offered_total;
+    counters->replaced += counts.replaced;
+    counters->rov_dropped += counts.dropped;
+    counters->policy_dropped += counts.rejected;
+  }
+}
+
+template void bgp_receive_rib<false>(BGPState&, const BGPState&, ASN, Rel, const uint64_t*, RouteCounters*);
+template void bgp_receive_rib<true>(BGPState&, const BGPState&, ASN, Rel, const uint64_t*, RouteCounters*);
+
+// Processes the receive queue for each prefix:
+// Prepends the local AS (path_len + 1) to the best candidate and stores it
+// if it beats the current RIB entry (relationship > shortest path > lowest next_hop).
+// A stored entry is never replaced by a worse one, so the next-hop chain used to
+// rebuild AS paths at output time stays consistent with what was advertised.
+uint32_t bgp_process_queue(BGPState& state) {
+  uint32_t updates = 0;
+  for_each_prefix(state.queue_present, state.prefix_words, [&](PrefixID prefix_id) {
+    Announcement best = state.recv_queue[prefix_id];
+    ++best.path_len;
+    if (!state.has_route(prefix_id) || best > state.rib[prefix_id]) {
+      store_route(state, prefix_id, best);
+      ++updates;
+    }
+  });
+  std::fill_n(state.queue_present, state.prefix_words, uint64_t{0});
+  return updates;
+}
@@ -1,17 +1,155 @@
 #pragma once
+#include "allocator.h"
 #include "announcement.h"
-#include <unordered_map>
+#include <bit>
+#include <cstddef>
+#include <memory>
 #include <vector>
 
-// Flat BGP state per AS (no virtual calls)
+// Import policies of an AS, combined as bits (see policy.h). Every
+// combination is a policy class with its own receive kernel.
+enum PolicyFlag : uint8_t {
+  POLICY_ROV = 1,            // drop ROV-invalid routes
+  POLICY_CUSTOMER_ONLY = 2,  // accept routes from customers only
+  POLICY_PEER_LOCK = 4,      // drop routes of a peer learned from anyone but that peer
+  POLICY_ASPA = 8,           // drop routes whose AS path fails ASPA verification
+};
+constexpr unsigned kNumPolicyClasses = 16;
+
+// Outcomes of received routes and queue processing (--stats)
+struct RouteCounters {
+  uint64_t received = 0;        // routes offered to a receive queue
+  uint64_t replaced = 0;        // offers that replaced a queued candidate
+  uint64_t rov_dropped = 0;     // offers dropped by ROV
+  uint64_t policy_dropped = 0;  // offers dropped by customer-only, peer lock or ASPA
+  uint64_t rib_updates = 0;     // queued candidates stored in the RIB
+
+  void add(const RouteCounters& other) {
+    received += other.received;
+    replaced += other.replaced;
+    rov_dropped += other.rov_dropped;
+    policy_dropped += other.policy_dropped;
+    rib_updates += other.rib_updates;
+  }
+};
+
+// BGPState::stub_provider of an AS that has rows of its own
+constexpr uint32_t kNotStub = UINT32_MAX;
+
+// Flat BGP state per AS (no virtual calls).
+// RIB and receive queue are dense rows indexed directly by PrefixID; a slot is
+// valid only if its bit is set in the matching presence bitmap.
+// A collapsed stub (see collapse_stubs) has no rows: its bitmaps are empty,
+// propagation skips it and its routes are derived from its provider's RIB.
 struct BGPState {
-  std::unordered_map<PrefixID, Announcement> rib;  // Local Routing Information Base indexed by prefix ID
-  std::unordered_map<PrefixID, Announcement> recv_queue;  // Best received announcement per prefix ID (pending)
-  bool is_rov = false;  // if true, drop rov_invalid announcements on receive
+  Announcement* rib = nullptr;         // Local Routing Information Base, one slot per prefix ID
+  Announcement* recv_queue = nullptr;  // Best received announcement per prefix ID (pending)
+  uint64_t* rib_present = nullptr;     // presence bitmap for rib
+  uint64_t* queue_present = nullptr;   // presence bitmap for recv_queue
+  uint32_t prefix_words = 0;           // number of 64-bit words per bitmap
+  uint32_t num_routes = 0;             // number of prefixes present in rib
+  uint8_t policy = 0;  // PolicyFlag bits; 0 = plain BGP
+  uint64_t rov_lanes = ~uint64_t{0};   // with POLICY_ROV: bit i set = ROV applies to slots i (mod 64); see sweep.h
+  uint32_t stub_provider = kNotStub;   // collapsed stub: node index of its only provider
+  ASN stub_provider_asn = 0;           // collapsed stub: ASN of that provider
+
+  bool is_stub() const { return stub_provider != kNotStub; }
+  bool has_route(PrefixID prefix_id) const {
+    return (rib_present[prefix_id >> 6] >> (prefix_id & 63)) & 1;
+  }
+};
+
+// Owns the per-prefix columns of all ASes of one run: num_states rows of
+// num_prefixes slots each, plus the presence bitmaps, all in one arena.
+// Slots are left uninitialized, so untouched rows never get committed by the OS.
+class BGPTable {
+public:
+  // huge_pages: back the rows with transparent huge pages
+  explicit BGPTable(bool huge_pages = false) : arena(std::size_t{1} << 20, huge_pages) {}
+
+  // (Re)binds states to empty rows. The previous run's storage is released in
+  // one reset and reused when it is large enough. Collapsed stubs get no rows,
+  // only a shared empty bitmap.
+  void init(std::vector<BGPState>& states, std::size_t num_prefixes);
+
+private:
+  Arena arena;
+};
+
+// Calls fn(prefix_id) for every bit set in a presence bitmap, in prefix order;
+// slot_mask keeps only the bits it has set in every word
+template <typename Func>
+inline void for_each_prefix(const uint64_t* bits, uint32_t words, Func&& fn, uint64_t slot_mask = ~uint64_t{0}) {
+  for (uint32_t w = 0; w < words; ++w) {
+    uint64_t word = bits[w] & slot_mask;
+    while (word) {
+      PrefixID prefix_id = (w << 6) | static_cast<PrefixID>(std::countr_zero(word));
+      word &= word - 1;
+      fn(prefix_id);
+    }
+  }
+}
+
+// The route a collapsed stub holds for a route of its provider: learned from
+// the provider, one hop longer
+inline Announcement stub_route(const Announcement& provider_ann, ASN provider_asn) {
+  Announcement ann = provider_ann;
+  ann.next_hop = provider_asn;
+  ++ann.path_len;
+  ann.rel = PROV;
+  return ann;
+}
+
+// Calls fn(prefix_id, ann) for every route of states[idx] in prefix order
+// (slots in slot_mask only, as for for_each_prefix).
+// A collapsed stub's routes are derived from its provider's RIB on the fly.
+template <typename Func>
+inline void for_each_route(const std::vector<BGPState>& states, uint32_t idx, Func&& fn,
+                           uint64_t slot_mask = ~uint64_t{0}) {
+  const BGPState& st = states[idx];
+  if (!st.is_stub()) {
+    for_each_prefix(st.rib_present, st.prefix_words, [&](PrefixID prefix_id) { fn(prefix_id, st.rib[prefix_id]); },
+                    slot_mask);
+    return;
+  }
+  const BGPState& provider = states[st.stub_provider];
+  for_each_prefix(provider.rib_present, provider.prefix_words, [&](PrefixID prefix_id) {
+    fn(prefix_id, stub_route(provider.rib[prefix_id], st.stub_provider_asn));
+  }, slot_mask);
+}
+
+// Which RIB slots hold the routes of one scenario and which prefix each slot
+// belongs to. A plain run has one slot per prefix; an ROV sweep (sweep.h)
+// puts prefix p of lane l in slot (p << shift) | l.
+struct LaneSlots {
+  uint32_t shift = 0;
+  uint64_t mask = ~uint64_t{0};  // the scenario's slots within every 64-slot word
+
+  PrefixID prefix(PrefixID slot) const { return slot >> shift; }
 };
 
-// Enqueue a received announcement into the per-prefix queue
-void bgp_receive(BGPState& state, PrefixID prefix_id, const Announcement& ann);
+// Stores an announcement directly in the RIB (used to seed origins and to restore saved routes)
+void bgp_originate(BGPState& state, PrefixID prefix_id, const Announcement& ann);
+
+// What bgp_receive did with an announcement
+enum ReceiveOutcome : uint8_t { RECV_DROPPED_ROV, RECV_QUEUED, RECV_REPLACED, RECV_KEPT };
+
+// Enqueue a received announcement into the per-prefix queue; ROV drops only
+// apply in the slots set in state.rov_lanes
+ReceiveOutcome bgp_receive(BGPState& state, PrefixID prefix_id, const Announcement& ann);
+
+// Offers every route in from's RIB to state's queue as learned from from_asn
+// over rel, with the same result as one bgp_receive per route. Works on one
+// 64-prefix bitmap word at a time: candidates are stamped and reduced against
+// the queue with packed route keys, using AVX-512 or AVX2 masked max-by-key
+// when the build targets them. kRov drops ROV-invalid routes in the slots set
+// in state.rov_lanes (state.policy is not read); routes whose bit is set in reject (one word per bitmap word, may
+// be null) are dropped as policy rejects. Outcomes are added to counters
+// unless it is null.
+template <bool kRov>
+void bgp_receive_rib(BGPState& state, const BGPState& from, ASN from_asn, Rel rel, const uint64_t* reject,
+                     RouteCounters* counters);
 
-// Process receive queues and update the local RIB according to selection rules
-void bgp_process_queue(BGPState& state, ASN self_asn);
\ No newline at end of file
+// Process receive queues and update the local RIB according to selection rules;
+// returns the number of RIB entries stored
+uint32_t bgp_process_queue(BGPState& state);
@@ -0,0 +1,411 @@
+// bgp_bench - microbenchmarks of the simulator's phases on a synthetic (seeded) or CAIDA topology
+// Prints one JSON document; --compare checks the medians against a stored result of an earlier run
+#include "as_graph.h"
+#include "bgp.h"
+#include "cone.h"
+#include "propagation.h"
+#include "result_store.h"
+#include "rib_writer.h"
+#include "thread_pool.h"
+#include "topology_gen.h"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static double ms_since(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Samples of one benchmark; items is the work done per sample (relationships, calls, routes, ...)
+struct Result {
+    std::string name;
+    uint64_t items = 0;
+    std::vector<double> ms;
+
+    double median() const {
+        std::vector<double> v = ms;
+        std::sort(v.begin(), v.end());
+        return v.size() % 2 ? v[v.size() / 2] : (v[v.size() / 2 - 1] + v[v.size() / 2]) / 2;
+    }
+};
+
+struct Options {
+    TopologyParams topo;
+    AnnouncementParams anns;
+    std::string caida_path;     // empty = synthetic topology
+    std::string dataset_dir;    // keep the generated inputs here
+    std::string json_path;      // empty = stdout
+    std::string compare_path;   // baseline JSON
+    double tolerance = 10.0;    // allowed median slowdown against the baseline, percent
+    unsigned threads = 1;
+    unsigned repeat = 5;
+    std::size_t prefix_batch = 0;
+    bool collapse_stubs = false;    // propagate with single-homed stubs collapsed
+    std::vector<std::string> only;  // benchmark names; empty = all
+};
+
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [--ases N] [--prefixes P] [--seed S] [--threads T] [--repeat R]"
+              << " [--prefix-batch N] [--collapse-stubs] [--only NAME,...] [--caida FILE] [--write-dataset DIR]"
+              << " [--json FILE] [--compare BASELINE.json] [--tolerance PCT]\n";
+}
+
+template <typename T>
+static bool parse_number(std::string_view v, T& out) {
+    auto res = std::from_chars(v.data(), v.data() + v.size(), out);
+    return res.ec == std::errc() && res.ptr == v.data() + v.size();
+}
+
+static bool parse_args(int argc, char* argv[], Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg(argv[i]);
+        if (arg == "--collapse-stubs") {
+            opt.collapse_stubs = true;
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        const std::string_view v(argv[++i]);
+        bool ok = true;
+        if (arg == "--ases") ok = parse_number(v, opt.topo.num_ases);
+        else if (arg == "--prefixes") ok = parse_number(v, opt.anns.num_prefixes);
+        else if (arg == "--seed") ok = parse_number(v, opt.topo.seed);
+        else if (arg == "--threads") ok = parse_number(v, opt.threads);
+        else if (arg == "--repeat") ok = parse_number(v, opt.repeat) && opt.repeat > 0;
+        else if (arg == "--prefix-batch") ok = parse_number(v, opt.prefix_batch);
+        else if (arg == "--tolerance") opt.tolerance = std::atof(std::string(v).c_str());
+        else if (arg == "--caida") opt.caida_path = v;
+        else if (arg == "--write-dataset") opt.dataset_dir = v;
+        else if (arg == "--json") opt.json_path = v;
+        else if (arg == "--compare") opt.compare_path = v;
+        else if (arg == "--only") {
+            std::stringstream list{std::string(v)};
+            for (std::string name; std::getline(list, name, ',');) {
+                if (!name.empty()) opt.only.push_back(name);
+            }
+        } else {
+            ok = false;
+        }
+        if (!ok) return false;
+    }
+    opt.anns.seed = opt.topo.seed;
+    if (opt.threads == 0) opt.threads = std::max(1u, std::thread::hardware_concurrency());
+    return true;
+}
+
+// Announcement generation needs the ASNs and customer links of the graph; for
+// a CAIDA graph they are taken from the loaded adjacency
+static void topology_of(const ASGraph& graph, SyntheticTopology& topo) {
+    topo.asns.clear();
+    topo.links.clear();
+    for (const ASNode& node : graph.nodes) topo.asns.push_back(node.asn);
+    for (uint32_t idx = 0; idx < graph.nodes.size(); ++idx) {
+        for (uint32_t c : graph.customers[idx]) topo.links.push_back({graph.nodes[idx].asn, graph.nodes[c].asn, false});
+    }
+}
+
+// Microbenchmark tables: small enough to stay cache-resident, so they measure
+// the per-call cost of the engine rather than memory bandwidth
+static constexpr uint32_t kMicroStates = 1024;
+static constexpr uint32_t kMicroPrefixes = 4096;
+static constexpr uint32_t kMicroCalls = 1u << 22;
+
+// Default batch: about 2^27 RIB slots (2 GiB of RIB and queue rows) at a time
+static constexpr std::size_t kDefaultBatchSlots = std::size_t{1} << 27;
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        usage(argv[0]);
+        return 1;
+    }
+    auto enabled = [&](std::string_view name) {
+        return opt.only.empty() || std::find(opt.only.begin(), opt.only.end(), name) != opt.only.end();
+    };
+
+    ThreadPool pool(opt.threads);
+    std::vector<Result> results;
+    auto add_result = [&](Result r) { results.push_back(std::move(r)); };
+
+    // Inputs: generated into the dataset directory (or a temporary one) as
+    // data/as-rel.txt.bz2, anns.csv and rov_asns.csv
+    namespace fs = std::filesystem;
+    const bool keep_dataset = !opt.dataset_dir.empty();
+    fs::path dir = keep_dataset ? fs::path(opt.dataset_dir)
+                                : fs::temp_directory_path() / ("bgp_bench." + std::to_string(::getpid()));
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (ec) {
+        std::cerr << "Cannot create " << dir << ": " << ec.message() << "\n";
+        return 1;
+    }
+
+    SyntheticTopology topo;
+    std::string caida_path = opt.caida_path;
+    if (caida_path.empty()) {
+        Result gen{"generate_topology", opt.topo.num_ases, {}};
+        const auto start = Clock::now();
+        generate_topology(opt.topo, topo);
+        gen.ms.push_back(ms_since(start));
+        if (enabled(gen.name)) add_result(std::move(gen));
+        // Same layout bgp_sim expects, so a kept dataset can be run with it directly
+        fs::create_directories(dir / "data", ec);
+        caida_path = (dir / "data" / "as-rel.txt.bz2").string();
+        if (!write_caida_bz2(topo, opt.topo.seed, caida_path)) {
+            std::cerr << "Cannot write " << caida_path << "\n";
+            return 1;
+        }
+    }
+
+    // load_from_caida (decompression, parsing, CSR build)
+    ASGraph graph;
+    {
+        Result r{"load_from_caida", 0, {}};
+        for (unsigned rep = 0; rep < opt.repeat; ++rep) {
+            ASGraph fresh;
+            const auto start = Clock::now();
+            if (!fresh.load_from_caida(caida_path, &pool)) {
+                std::cerr << "Cannot load " << caida_path << "\n";
+                return 1;
+            }
+            r.ms.push_back(ms_since(start));
+            graph = std::move(fresh);
+        }
+        r.items = graph.providers.offsets()[graph.nodes.size()] + graph.peers.offsets()[graph.nodes.size()] / 2;
+        if (enabled(r.name)) add_result(std::move(r));
+    }
+    if (topo.asns.empty()) topology_of(graph, topo);
+
+    // rank_topology (cycle check and ranking) and renumbering
+    std::vector<std::vector<uint32_t>> ranks;
+    {
+        Result r{"rank_topology", graph.nodes.size(), {}};
+        for (unsigned rep = 0; rep < opt.repeat; ++rep) {
+            const auto start = Clock::now();
+            if (!graph.rank_topology(ranks, &pool)) {
+                std::cerr << "Cycle in the provider/customer relationships\n";
+                return 1;
+            }
+            r.ms.push_back(ms_since(start));
+        }
+        if (enabled(r.name)) add_result(std::move(r));
+        Result renumber{"renumber_by_rank", graph.nodes.size(), {}};
+        const auto start = Clock::now();
+        graph.renumber_by_rank(ranks);
+        renumber.ms.push_back(ms_since(start));
+        if (enabled(renumber.name)) add_result(std::move(renumber));
+    }
+
+    // Customer cones over the rank layers
+    if (enabled("customer_cones")) {
+        Result r{"customer_cones", graph.nodes.size(), {}};
+        for (unsigned rep = 0; rep < opt.repeat; ++rep) {
+            CustomerCones cones;
+            const auto start = Clock::now();
+            cones.build(graph, ranks, pool);
+            r.ms.push_back(ms_since(start));
+        }
+        add_result(std::move(r));
+    }
+
+    SyntheticAnnouncements anns;
+    generate_announcements(topo, opt.anns, anns);
+    if (keep_dataset && !write_announcements(anns, (dir / "anns.csv").string(), (dir / "rov_asns.csv").string())) {
+        std::cerr << "Cannot write the announcements to " << dir << "\n";
+        return 1;
+    }
+
+    // bgp_receive / bgp_process_queue on cache-resident tables
+    if (enabled("bgp_receive") || enabled("bgp_process_queue")) {
+        const uint32_t num_prefixes = std::clamp<uint32_t>(opt.anns.num_prefixes, 1, kMicroPrefixes);
+        std::vector<BGPState> states(kMicroStates);
+        BGPTable table;
+        struct Call {
+            uint32_t state;
+            PrefixID prefix_id;
+            Announcement ann;
+        };
+        std::vector<Call> calls(kMicroCalls);
+        uint64_t x = opt.topo.seed;
+        auto next = [&x] {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            return x;
+        };
+        for (Call& c : calls) {
+            const uint64_t r = next();
+            c.state = static_cast<uint32_t>(r % kMicroStates);
+            c.prefix_id = static_cast<PrefixID>((r >> 16) % num_prefixes);
+            c.ann = Announcement{static_cast<ASN>(r >> 40), static_cast<uint16_t>(1 + ((r >> 32) & 7)),
+                                 static_cast<Rel>((r >> 36) % 3), ((r >> 39) & 1) != 0};
+        }
+        for (std::size_t i = 0; i < states.size(); ++i) states[i].policy = i % 4 == 0 ? POLICY_ROV : 0;
+
+        Result receive{"bgp_receive", kMicroCalls, {}};
+        Result process{"bgp_process_queue", 0, {}};
+        for (unsigned rep = 0; rep < opt.repeat; ++rep) {
+            table.init(states, num_prefixes);
+            auto start = Clock::now();
+            for (const Call& c : calls) bgp_receive(states[c.state], c.prefix_id, c.ann);
+            receive.ms.push_back(ms_since(start));
+
+            uint64_t queued = 0;
+            for (const BGPState& st : states) {
+                for (uint32_t w = 0; w < st.prefix_words; ++w) queued += std::popcount(st.queue_present[w]);
+            }
+            start = Clock::now();
+            for (BGPState& st : states) bgp_process_queue(st);
+            process.ms.push_back(ms_since(start));
+            process.items = queued;
+        }
+        if (enabled(receive.name)) add_result(std::move(receive));
+        if (enabled(process.name)) add_result(std::move(process));
+    }
+
+    // propagate / write_ribs / build_store_segment over the generated announcements
+    uint64_t total_routes = 0;
+    if (enabled("propagate") || enabled("write_ribs") || enabled("build_store_segment")) {
+        const std::size_t total_prefixes = anns.prefixes.size();
+        std::size_t batch_size = opt.prefix_batch;
+        if (batch_size == 0) batch_size = std::max<std::size_t>(1, kDefaultBatchSlots / std::max<std::size_t>(1, graph.nodes.size()));
+        batch_size = std::min(batch_size, std::max<std::size_t>(total_prefixes, 1));
+        const std::size_t num_batches = (total_prefixes + batch_size - 1) / batch_size;
+
+        std::vector<BGPState> states(graph.nodes.size());
+        std::vector<ASN> rov = anns.rov_asns;
+        for (uint32_t idx = 0; idx < graph.nodes.size(); ++idx) {
+            states[idx].policy = std::binary_search(rov.begin(), rov.end(), graph.nodes[idx].asn) ? POLICY_ROV : 0;
+        }
+        const AsnLookup lookup(graph);
+        if (opt.collapse_stubs) {
+            std::vector<char> originates(graph.nodes.size(), 0);
+            for (const SyntheticAnnouncement& row : anns.rows) {
+                const uint32_t idx = lookup.find(row.asn);
+                if (idx != AsnLookup::kNotFound) originates[idx] = 1;
+            }
+            collapse_stubs(graph, originates, states);
+        }
+        std::vector<uint32_t> nodes(graph.nodes.size());
+        std::iota(nodes.begin(), nodes.end(), 0u);
+        std::vector<uint32_t> store_nodes = nodes;
+        std::sort(store_nodes.begin(), store_nodes.end(), [&](uint32_t a, uint32_t b) {
+            return graph.nodes[a].asn < graph.nodes[b].asn;
+        });
+        OutputSink sink;
+        if (!sink.open("/dev/null")) return 1;
+
+        Result prop{"propagate", 0, {}};
+        Result write{"write_ribs", 0, {}};
+        Result store{"build_store_segment", 0, {}};
+        BGPTable table;
+        StoreSegment segment;
+        for (unsigned rep = 0; rep < opt.repeat; ++rep) {
+            double prop_ms = 0, write_ms = 0, store_ms = 0;
+            total_routes = 0;
+            for (std::size_t b = 0; b < num_batches; ++b) {
+                const PrefixID base = static_cast<PrefixID>(b * batch_size);
+                const std::size_t count = std::min(batch_size, total_prefixes - base);
+                table.init(states, count);
+                for (const SyntheticAnnouncement& row : anns.rows) {
+                    if (row.prefix < base || row.prefix >= base + count) continue;
+                    const uint32_t idx = lookup.find(row.asn);
+                    if (idx == AsnLookup::kNotFound) continue;
+                    bgp_originate(states[idx], row.prefix - base, Announcement{row.asn, 1, ORIGIN, row.rov_invalid});
+                }
+                auto start = Clock::now();
+                propagate(graph, ranks, states, pool);
+                prop_ms += ms_since(start);
+                for (const BGPState& st : states) total_routes += st.num_routes;
+
+                if (enabled("write_ribs")) {
+                    start = Clock::now();
+                    write_ribs(sink, graph, lookup, states, nodes, anns.prefixes, base, pool);
+                    write_ms += ms_since(start);
+                }
+                if (enabled("build_store_segment")) {
+                    start = Clock::now();
+                    build_store_segment(segment, lookup, states, store_nodes, base, count, pool);
+                    store_ms += ms_since(start);
+                }
+            }
+            prop.ms.push_back(prop_ms);
+            write.ms.push_back(write_ms);
+            store.ms.push_back(store_ms);
+        }
+        prop.items = write.items = store.items = total_routes;
+        if (enabled(prop.name)) add_result(std::move(prop));
+        if (enabled(write.name)) add_result(std::move(write));
+        if (enabled(store.name)) add_result(std::move(store));
+    }
+
+    if (!keep_dataset) fs::remove_all(dir, ec);
+
+    // One result per line, so --compare (and line-based tools) can read it back
+    std::ostringstream json;
+    json << "{\n  \"config\": {\"source\": \"" << (opt.caida_path.empty() ? "synthetic" : opt.caida_path)
+         << "\", \"ases\": " << graph.nodes.size() << ", \"prefixes\": " << anns.prefixes.size()
+         << ", \"ranks\": " << ranks.size() << ", \"announcements\": " << anns.rows.size() << ", \"routes\": " << total_routes
+         << ", \"seed\": " << opt.topo.seed << ", \"threads\": " << opt.threads
+         << ", \"repeat\": " << opt.repeat << "},\n  \"results\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        const double median = r.median();
+        json << "    {\"name\": \"" << r.name << "\", \"items\": " << r.items
+             << ", \"samples\": " << r.ms.size()
+             << ", \"min_ms\": " << *std::min_element(r.ms.begin(), r.ms.end())
+             << ", \"median_ms\": " << median
+             << ", \"mean_ms\": " << std::accumulate(r.ms.begin(), r.ms.end(), 0.0) / r.ms.size()
+             << ", \"items_per_sec\": " << (median > 0 ? r.items / (median / 1000.0) : 0.0) << "}"
+             << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n}\n";
+
+    if (opt.json_path.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream out(opt.json_path);
+        if (!(out << json.str())) {
+            std::cerr << "Cannot write " << opt.json_path << "\n";
+            return 1;
+        }
+    }
+
+    if (opt.compare_path.empty()) return 0;
+    std::ifstream baseline(opt.compare_path);
+    if (!baseline.is_open()) {
+        std::cerr << "Cannot open baseline " << opt.compare_path << "\n";
+        return 1;
+    }
+    // Reads the result lines written above: "name" and "median_ms" fields
+    bool regression = false;
+    for (std::string line; std::getline(baseline, line);) {
+        const auto name_at = line.find("\"name\": \"");
+        const auto median_at = line.find("\"median_ms\": ");
+        if (name_at == std::string::npos || median_at == std::string::npos) continue;
+        const auto name_begin = name_at + 9;
+        const std::string name = line.substr(name_begin, line.find('"', name_begin) - name_begin);
+        const double base = std::atof(line.c_str() + median_at + 13);
+        auto it = std::find_if(results.begin(), results.end(), [&](const Result& r) { return r.name == name; });
+        if (it == results.end() || base <= 0) continue;
+        const double change = (it->median() / base - 1.0) * 100.0;
+        const bool slower = change > opt.tolerance;
+        regression = regression || slower;
+        std::cerr << name << ": " << base << " ms -> " << it->median() << " ms (" << (change >= 0 ? "+" : "")
+                  << change << "%)" << (slower ? "  REGRESSION" : "") << "\n";
+    }
+    return regression ? 3 : 0;
+}
@@ -0,0 +1,150 @@
+// bgp_cones - customer cone sizes, cone membership and valley-free reachability over the CAIDA graph
+// Uses the simulator's graph snapshot when it is current; cones are built once per run on all requested threads
+#include "as_graph.h"
+#include "cone.h"
+#include "graph_snapshot.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [--threads N] [--caida FILE] [--graph-cache PATH | --no-graph-cache] <command>\n"
+              << "  sizes                    asn,cone_size of every AS\n"
+              << "  cone <asn>               ASes in the customer cone of asn\n"
+              << "  in-cone <asn> <member>   whether member is in the customer cone of asn\n"
+              << "  reach <src> [dst]        number of ASes src reaches valley-free, or whether it reaches dst\n";
+}
+
+static bool parse_asn(std::string_view v, ASN& asn) {
+    auto res = std::from_chars(v.data(), v.data() + v.size(), asn);
+    return res.ec == std::errc() && res.ptr == v.data() + v.size();
+}
+
+// Loads the ranked graph from the snapshot if it matches the CAIDA file, else
+// from the CAIDA file itself (the snapshot is left to bgp_sim)
+static bool load_graph(const std::string& caida_path, const std::string& graph_cache, ASGraph& graph,
+                       std::vector<std::vector<uint32_t>>& ranks, ThreadPool& pool) {
+    uint64_t source_hash = 0;
+    if (!graph_cache.empty() && hash_file(caida_path, source_hash) &&
+        load_graph_snapshot(graph_cache, source_hash, graph, ranks)) {
+        return true;
+    }
+    if (!graph.load_from_caida(caida_path, &pool)) {
+        std::cerr << "Error loading CAIDA data\n";
+        return false;
+    }
+    if (!graph.rank_topology(ranks, &pool)) {
+        std::cerr << "Cycle detected in AS relationships\n";
+        return false;
+    }
+    graph.renumber_by_rank(ranks);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::string caida_path = "data/as-rel.txt.bz2";
+    std::string graph_cache;
+    bool use_cache = true;
+    unsigned num_threads = 1;
+    std::vector<std::string_view> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg(argv[i]);
+        if (arg == "--caida" && i + 1 < argc) {
+            caida_path = argv[++i];
+        } else if (arg == "--graph-cache" && i + 1 < argc) {
+            graph_cache = argv[++i];
+        } else if (arg == "--no-graph-cache") {
+            use_cache = false;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            std::string_view v(argv[++i]);
+            auto res = std::from_chars(v.data(), v.data() + v.size(), num_threads);
+            if (res.ec != std::errc()) {
+                usage(argv[0]);
+                return 1;
+            }
+            if (num_threads == 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (use_cache && graph_cache.empty()) graph_cache = caida_path + ".snapshot";
+    if (!use_cache) graph_cache.clear();
+
+    // The ASes a command takes after its name
+    const std::string_view cmd = args.empty() ? std::string_view() : args[0];
+    std::size_t min_asns = 0, max_asns = 0;
+    if (cmd == "cone") {
+        min_asns = max_asns = 1;
+    } else if (cmd == "in-cone") {
+        min_asns = max_asns = 2;
+    } else if (cmd == "reach") {
+        min_asns = 1;
+        max_asns = 2;
+    } else if (cmd != "sizes") {
+        usage(argv[0]);
+        return 1;
+    }
+    ASN a = 0, b = 0;
+    if (args.size() < 1 + min_asns || args.size() > 1 + max_asns ||
+        (args.size() > 1 && !parse_asn(args[1], a)) || (args.size() > 2 && !parse_asn(args[2], b))) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    ThreadPool pool(num_threads);
+    ASGraph graph;
+    std::vector<std::vector<uint32_t>> ranks;
+    if (!load_graph(caida_path, graph_cache, graph, ranks, pool)) return 1;
+    auto find = [&](ASN asn, uint32_t& node) {
+        auto it = graph.asn_to_index.find(asn);
+        if (it == graph.asn_to_index.end()) {
+            std::cerr << "AS not in graph: " << asn << "\n";
+            return false;
+        }
+        node = it->second;
+        return true;
+    };
+    uint32_t node_a = 0, node_b = 0;
+    if ((args.size() > 1 && !find(a, node_a)) || (args.size() > 2 && !find(b, node_b))) return 2;
+
+    const auto start = std::chrono::steady_clock::now();
+    CustomerCones cones;
+    cones.build(graph, ranks, pool);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "Customer cones of " << graph.nodes.size() << " ASes in " << ms << " ms, "
+              << cones.memory_bytes() / (1024.0 * 1024.0) << " MiB\n";
+
+    std::string out;
+    if (cmd == "sizes") {
+        std::vector<uint32_t> order(graph.nodes.size());
+        for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) {
+            return graph.nodes[x].asn < graph.nodes[y].asn;
+        });
+        out = "asn,cone_size\n";
+        for (uint32_t node : order) {
+            out += std::to_string(graph.nodes[node].asn) + "," + std::to_string(cones.cone(node).size()) + "\n";
+        }
+    } else if (cmd == "cone") {
+        std::vector<ASN> members;
+        members.reserve(cones.cone(node_a).size());
+        cones.cone(node_a).for_each([&](uint32_t node) { members.push_back(graph.nodes[node].asn); });
+        std::sort(members.begin(), members.end());
+        for (ASN asn : members) out += std::to_string(asn) + "\n";
+    } else if (cmd == "in-cone") {
+        out = cones.in_cone(node_a, node_b) ? "yes\n" : "no\n";
+    } else if (args.size() > 2) {
+        out = cones.reachable(node_a, node_b) ? "yes\n" : "no\n";
+    } else {
+        std::vector<uint64_t> bits;
+        out = std::to_string(cones.reachable_set(node_a, bits)) + "\n";
+    }
+    std::cout << out;
+    return 0;
+}
@@ -0,0 +1,210 @@
+// bgp_query - answers route lookups from a result store written by bgp_sim --result-store
+// Only the touched parts of the mapped store are read; nothing is loaded up front
+#include "fib.h"
+#include "result_store.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " <store> info\n"
+              << "       " << argv0 << " <store> route <asn> <prefix>   route of one AS to one prefix\n"
+              << "       " << argv0 << " <store> routes <asn>           all routes of one AS\n"
+              << "       " << argv0 << " <store> via <asn> [prefix]     all routes whose AS path contains asn\n"
+              << "       " << argv0 << " <store> lookup <asn> <address> route of one AS to an IPv4 address (longest match)\n"
+              << "       " << argv0 << " <store> forward <asn> <address> hop-by-hop forwarding path to an address\n"
+              << "       " << argv0 << " <store> forward-batch [threads] forwarding paths of \"<asn> <address>\" lines on stdin\n";
+}
+
+static bool parse_asn(std::string_view v, ASN& asn) {
+    auto res = std::from_chars(v.data(), v.data() + v.size(), asn);
+    return res.ec == std::errc() && res.ptr == v.data() + v.size();
+}
+
+// Same row format as the simulator's CSV: asn,prefix,asn-hop-...-origin
+static void print_row(std::string& out, const ResultStore& store, uint32_t node, PrefixID prefix_id,
+                      std::span<const uint32_t> path) {
+    const std::string asn = std::to_string(store.node_asn(node));
+    out += asn;
+    out += ',';
+    out += store.prefix(prefix_id);
+    out += ',';
+    out += asn;
+    for (uint32_t hop : path) {
+        out += '-';
+        out += std::to_string(hop);
+    }
+    out += '\n';
+    if (out.size() >= (1u << 20)) {
+        std::cout << out;
+        out.clear();
+    }
+}
+
+// Reads "<asn> <address>" lines (space or comma separated, '#' starts a
+// comment line) from stdin; false with a message on the first malformed line
+static bool read_queries(std::vector<ForwardQuery>& queries) {
+    std::ostringstream buffer;
+    buffer << std::cin.rdbuf();
+    const std::string text = std::move(buffer).str();
+    std::string_view rest(text);
+    for (std::size_t line_no = 1; !rest.empty(); ++line_no) {
+        const std::size_t eol = rest.find('\n');
+        std::string_view line = rest.substr(0, eol);
+        rest.remove_prefix(eol == std::string_view::npos ? rest.size() : eol + 1);
+        const std::size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string_view::npos || line[start] == '#') continue;
+        line = line.substr(start, line.find_last_not_of(" \t\r") + 1 - start);
+        const std::size_t sep = line.find_first_of(" \t,");
+        ForwardQuery query{};
+        std::string_view addr_text;
+        if (sep != std::string_view::npos) {
+            addr_text = line.substr(sep + 1);
+            addr_text.remove_prefix(std::min(addr_text.size(), addr_text.find_first_not_of(" \t")));
+        }
+        if (sep == std::string_view::npos || !parse_asn(line.substr(0, sep), query.asn) ||
+            !parse_ipv4(addr_text, query.addr)) {
+            std::cerr << "stdin:" << line_no << ": expected <asn> <address>\n";
+            return false;
+        }
+        queries.push_back(query);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+    ResultStore store;
+    if (!store.open(argv[1])) return 1;
+    const std::string_view cmd(argv[2]);
+
+    if (cmd == "info") {
+        std::cout << "nodes: " << store.num_nodes() << "\n"
+                  << "prefixes: " << store.num_prefixes() << "\n"
+                  << "segments: " << store.num_segments() << "\n"
+                  << "routes: " << store.num_routes() << "\n";
+        return 0;
+    }
+
+    // Forwarding queries match IPv4 addresses against the store's prefixes
+    if (cmd == "forward-batch") {
+        unsigned num_threads = 1;
+        if (argc >= 4) {
+            std::string_view tv(argv[3]);
+            auto res = std::from_chars(tv.data(), tv.data() + tv.size(), num_threads);
+            if (res.ec != std::errc()) {
+                usage(argv[0]);
+                return 1;
+            }
+            if (num_threads == 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        std::vector<ForwardQuery> queries;
+        if (!read_queries(queries)) return 1;
+        const auto start = std::chrono::steady_clock::now();
+        ForwardingTable table(store);
+        table.build();
+        ThreadPool pool(num_threads);
+        OutputSink sink;
+        sink.write("asn,address,prefix,path,outcome\n");
+        forward_batch(sink, store, table, queries, pool);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cerr << "Forwarded " << queries.size() << " queries in " << ms << " ms\n";
+        return sink.ok() ? 0 : 1;
+    }
+    if (cmd == "lookup" || cmd == "forward") {
+        ForwardQuery query{};
+        if (argc < 5 || !parse_asn(argv[3], query.asn) || !parse_ipv4(argv[4], query.addr)) {
+            usage(argv[0]);
+            return 1;
+        }
+        const uint32_t node = store.find_node(query.asn);
+        if (node == ResultStore::kNotFound) {
+            std::cerr << "AS not in store: " << query.asn << "\n";
+            return 2;
+        }
+        ForwardingTable table(store);
+        table.build();
+        std::string out;
+        if (cmd == "lookup") {
+            uint64_t route = 0;
+            const PrefixID prefix_id = table.route_for(node, query.addr, route);
+            std::span<const uint32_t> path;
+            if (prefix_id == ForwardingTable::kNoPrefix || !store.route(node, prefix_id, path)) {
+                std::cerr << "No route from AS " << query.asn << " to " << argv[4] << "\n";
+                return 2;
+            }
+            out = "asn,prefix,as_path\n";
+            print_row(out, store, node, prefix_id, path);
+        } else {
+            std::vector<ASN> hops;
+            PrefixID prefix_id = ForwardingTable::kNoPrefix;
+            const ForwardOutcome outcome = table.forward(node, query.addr, hops, prefix_id);
+            out = "asn,address,prefix,path,outcome\n";
+            append_forward_row(out, store, query, prefix_id, hops, outcome);
+        }
+        std::cout << out;
+        return 0;
+    }
+
+    ASN asn = 0;
+    if (argc < 4 || !parse_asn(argv[3], asn)) {
+        usage(argv[0]);
+        return 1;
+    }
+    PrefixID prefix_id = ResultStore::kNotFound;
+    if (argc >= 5) {
+        prefix_id = store.find_prefix(argv[4]);
+        if (prefix_id == ResultStore::kNotFound) {
+            std::cerr << "Prefix not in store: " << argv[4] << "\n";
+            return 2;
+        }
+    }
+
+    std::string out = "asn,prefix,as_path\n";
+    if (cmd == "route" || cmd == "routes") {
+        const uint32_t node = store.find_node(asn);
+        if (node == ResultStore::kNotFound) {
+            std::cerr << "AS not in store: " << asn << "\n";
+            return 2;
+        }
+        if (cmd == "route") {
+            if (argc < 5) {
+                usage(argv[0]);
+                return 1;
+            }
+            std::span<const uint32_t> path;
+            if (!store.route(node, prefix_id, path)) {
+                std::cerr << "No route from AS " << asn << " to " << argv[4] << "\n";
+                return 2;
+            }
+            print_row(out, store, node, prefix_id, path);
+        } else {
+            store.for_each_route_of(node, [&](uint32_t n, PrefixID p, std::span<const uint32_t> path) {
+                print_row(out, store, n, p, path);
+            });
+        }
+    } else if (cmd == "via") {
+        // The AS itself counts as part of its path, as in the CSV
+        store.for_each_route([&](uint32_t node, PrefixID p, std::span<const uint32_t> path) {
+            if (prefix_id != ResultStore::kNotFound && p != prefix_id) return;
+            bool hit = store.node_asn(node) == asn;
+            for (std::size_t i = 0; !hit && i < path.size(); ++i) hit = path[i] == asn;
+            if (hit) print_row(out, store, node, p, path);
+        });
+    } else {
+        usage(argv[0]);
+        return 1;
+    }
+    std::cout << out;
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "bz2_blocks.h"
+#include <bzlib.h>
+#include <cstring>
+
+static constexpr uint64_t kBlockMagic = 0x314159265359ull;  // BCD pi
+static constexpr uint64_t kEndMagic = 0x177245385090ull;    // BCD sqrt(pi)
+static constexpr uint64_t kMagicMask = (uint64_t{1} << 48) - 1;
+
+static inline unsigned get_bit(const unsigned char* data, uint64_t pos) {
+    return (data[pos >> 3] >> (7 - (pos & 7))) & 1u;
+}
+
+static inline uint32_t get_bits32(const unsigned char* data, uint64_t pos) {
+    uint32_t v = 0;
+    for (int i = 0; i < 32; ++i) v = (v << 1) | get_bit(data, pos + i);
+    return v;
+}
+
+static inline bool is_stream_header(const unsigned char* data, std::size_t size, std::size_t at) {
+    return at + 4 <= size && data[at] == 'B' && data[at + 1] == 'Z' && data[at + 2] == 'h' &&
+           data[at + 3] >= '1' && data[at + 3] <= '9';
+}
+
+bool find_bz2_blocks(const unsigned char* data, std::size_t size, std::vector<Bz2Block>& blocks) {
+    blocks.clear();
+    if (!is_stream_header(data, size, 0)) return false;
+
+    char level = static_cast<char>(data[3]);
+    bool in_block = false;
+    uint64_t reg = 0;
+    uint64_t reg_begin = 32;  // first bit shifted into reg since the last reset
+    const uint64_t total_bits = uint64_t{size} * 8;
+    for (uint64_t pos = reg_begin; pos < total_bits; ++pos) {
+        reg = (reg << 1) | get_bit(data, pos);
+        if (pos + 1 - reg_begin < 48) continue;
+        const uint64_t marker = reg & kMagicMask;
+        if (marker != kBlockMagic && marker != kEndMagic) continue;
+
+        const uint64_t start = pos + 1 - 48;
+        if (in_block) blocks.back().bit_end = start;
+        if (marker == kBlockMagic) {
+            if (start + 48 + 32 > total_bits) return false;
+            blocks.push_back(Bz2Block{start, 0, get_bits32(data, start + 48), level});
+            in_block = true;
+            reg_begin = start + 48 + 32;  // skip the block CRC
+        } else {
+            // End of stream: 32-bit combined CRC, then padding to a byte boundary
+            if (!in_block) return false;
+            in_block = false;
+            const std::size_t next = static_cast<std::size_t>((start + 48 + 32 + 7) / 8);
+            if (next >= size || !is_stream_header(data, size, next)) {
+                return next <= size;  // trailing garbage after the last stream is ignored
+            }
+            level = static_cast<char>(data[next + 3]);
+            reg_begin = uint64_t{next + 4} * 8;
+        }
+        pos = reg_begin - 1;
+        reg = 0;
+    }
+    return false;  // ran out of data inside a stream
+}
+
+bool decompress_bz2_block(const unsigned char* data, const Bz2Block& block, std::string& out) {
+    // Standalone stream: "BZh<level>", the block bits, end magic, combined CRC
+    // (equal to the block CRC for a single block), zero padding
+    const uint64_t nbits = block.bit_end - block.bit_begin;
+    std::vector<unsigned char> stream(4 + static_cast<std::size_t>((nbits + 48 + 32 + 7) / 8), 0);
+    stream[0] = 'B';
+    stream[1] = 'Z';
+    stream[2] = 'h';
+    stream[3] = static_cast<unsigned char>(block.level);
+    uint64_t w = 32;
+    auto put_bit = [&](unsigned bit) {
+        if (bit) stream[w >> 3] |= static_cast<unsigned char>(0x80u >> (w & 7));
+        ++w;
+    };
+    for (uint64_t pos = block.bit_begin; pos < block.bit_end; ++pos) put_bit(get_bit(data, pos));
+    for (int i = 47; i >= 0; --i) put_bit(static_cast<unsigned>((kEndMagic >> i) & 1));
+    for (int i = 31; i >= 0; --i) put_bit((block.crc >> i) & 1u);
+
+    bz_stream strm;
+    std::memset(&strm, 0, sizeof(strm));
+    if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) return false;
+    strm.next_in = reinterpret_cast<char*>(stream.data());
+    strm.avail_in = static_cast<unsigned>(stream.size());
+    int ret = BZ_OK;
+    while (ret == BZ_OK) {
+        std::size_t used = out.size();
+        out.resize(used + (1u << 20));
+        strm.next_out = out.data() + used;
+        strm.avail_out = 1u << 20;
+        ret = BZ2_bzDecompress(&strm);
+        out.resize(used + (1u << 20) - strm.avail_out);
+    }
+    BZ2_bzDecompressEnd(&strm);
+    return ret == BZ_STREAM_END;
+}
+
+bool decompress_bz2_stream(const unsigned char* data, std::size_t size, std::size_t chunk_size,
+                           const std::function<void(const char*, std::size_t)>& sink) {
+    std::vector<char> buf(chunk_size);
+    std::size_t offset = 0;
+    // One iteration per concatenated stream
+    while (offset < size) {
+        bz_stream strm;
+        std::memset(&strm, 0, sizeof(strm));
+        if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) return false;
+        strm.next_in = const_cast<char*>(reinterpret_cast<const char*>(data + offset));
+        strm.avail_in = static_cast<unsigned>(size - offset);
+        int ret = BZ_OK;
+        while (ret == BZ_OK) {
+            strm.next_out = buf.data();
+            strm.avail_out = static_cast<unsigned>(buf.size());
+            ret = BZ2_bzDecompress(&strm);
+            std::size_t produced = buf.size() - strm.avail_out;
+            if (produced > 0) sink(buf.data(), produced);
+            if (ret == BZ_OK && produced == 0 && strm.avail_in == 0) ret = BZ_UNEXPECTED_EOF;
+        }
+        offset = size - strm.avail_in;
+        BZ2_bzDecompressEnd(&strm);
+        if (ret != BZ_STREAM_END) return false;
+        // Trailing garbage after the last stream is ignored, like bzip2 does
+        if (!(offset + 4 <= size && std::memcmp(data + offset, "BZh", 3) == 0)) break;
+    }
+    return true;
+}
@@ -0,0 +1,30 @@
+// bz2 block splitting - cuts a bzip2 file image into independently decodable pieces
+// Every compressed block is rewrapped as a single-block stream (as bzip2recover does),
+// so blocks of one stream and blocks of concatenated streams can be decoded in parallel
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Location of one compressed block inside the file image, in bits
+struct Bz2Block {
+    uint64_t bit_begin;  // first bit of the block magic
+    uint64_t bit_end;    // first bit of the next block or end-of-stream magic
+    uint32_t crc;        // block CRC (stored right after the magic)
+    char level;          // block size digit '1'..'9' of the enclosing stream
+};
+
+// Finds all blocks of a (possibly multi-stream) bzip2 image. Returns false if
+// the markers are inconsistent; callers then decode the image sequentially.
+bool find_bz2_blocks(const unsigned char* data, std::size_t size, std::vector<Bz2Block>& blocks);
+
+// Decodes one block (rewrapped as a standalone stream) and appends its bytes to out
+bool decompress_bz2_block(const unsigned char* data, const Bz2Block& block, std::string& out);
+
+// Decodes a whole image (all concatenated streams) in chunks of up to chunk_size
+// bytes, calling sink(chunk, length) for each chunk in order
+bool decompress_bz2_stream(const unsigned char* data, std::size_t size, std::size_t chunk_size,
+                           const std::function<void(const char*, std::size_t)>& sink);
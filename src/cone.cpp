@@ -0,0 +1,110 @@
+#include "cone.h"
+#include "mempool.h"
+#include <algorithm>
+#include <cstring>
+
+bool NodeSet::contains(uint32_t node) const {
+    if (dense()) return (bits[node >> 6] >> (node & 63)) & 1;
+    return std::binary_search(items.begin(), items.end(), node);
+}
+
+void NodeSet::or_into(uint64_t* words) const {
+    for (uint32_t node : items) words[node >> 6] |= uint64_t{1} << (node & 63);
+    for (std::size_t w = 0; w < bits.size(); ++w) words[w] |= bits[w];
+}
+
+void CustomerCones::build(const ASGraph& graph, const std::vector<std::vector<uint32_t>>& ranks, ThreadPool& pool) {
+    this->graph = &graph;
+    const std::size_t num_nodes = graph.nodes.size();
+    num_words = (num_nodes + 63) / 64;
+    // An array beats the bitmap up to num_nodes / 32 members (4 bytes each vs. one bit per node)
+    const std::size_t max_sparse = std::max<std::size_t>(num_nodes / 32, 1);
+    cones.assign(num_nodes, NodeSet());
+
+    for (const std::vector<uint32_t>& rank : ranks) {
+        // Upper bound of a node's cone: itself plus its customers' cones
+        auto bound = [&](uint32_t node) {
+            std::size_t total = 1;
+            for (uint32_t c : graph.customers[node]) total += cones[c].size();
+            return total;
+        };
+        pool.parallel_for(rank.size(), [&](std::size_t i) { return bound(rank[i]); }, [&](std::size_t i) {
+            const uint32_t node = rank[i];
+            NodeSet& set = cones[node];
+            const std::size_t total = bound(node);
+            if (total <= max_sparse) {
+                // No customer set is dense (each is smaller than total): merge the arrays
+                set.items.reserve(total);
+                set.items.push_back(node);
+                for (uint32_t c : graph.customers[node]) {
+                    set.items.insert(set.items.end(), cones[c].items.begin(), cones[c].items.end());
+                }
+                std::sort(set.items.begin(), set.items.end());
+                set.items.erase(std::unique(set.items.begin(), set.items.end()), set.items.end());
+                set.items.shrink_to_fit();
+                set.count = set.items.size();
+                return;
+            }
+            // OR the customers' sets into a bitmap, then keep whichever form is smaller
+            ScratchArray<uint64_t> words(num_words);
+            std::memset(words.data(), 0, num_words * sizeof(uint64_t));
+            words[node >> 6] |= uint64_t{1} << (node & 63);
+            for (uint32_t c : graph.customers[node]) cones[c].or_into(words.data());
+            std::size_t count = 0;
+            for (std::size_t w = 0; w < num_words; ++w) count += static_cast<std::size_t>(std::popcount(words[w]));
+            set.count = count;
+            if (count <= max_sparse) {
+                set.items.reserve(count);
+                for (std::size_t w = 0; w < num_words; ++w) {
+                    for (uint64_t word = words[w]; word; word &= word - 1) {
+                        set.items.push_back(static_cast<uint32_t>((w << 6) | std::countr_zero(word)));
+                    }
+                }
+            } else {
+                set.bits.assign(words.data(), words.data() + num_words);
+            }
+        });
+    }
+}
+
+std::size_t CustomerCones::memory_bytes() const {
+    std::size_t bytes = cones.capacity() * sizeof(NodeSet);
+    for (const NodeSet& set : cones) bytes += set.memory_bytes();
+    return bytes;
+}
+
+void CustomerCones::uphill(uint32_t src, std::vector<uint32_t>& out) const {
+    out.assign(1, src);
+    for (std::size_t i = 0; i < out.size(); ++i) {
+        for (uint32_t p : graph->providers[out[i]]) {
+            if (std::find(out.begin(), out.end(), p) == out.end()) out.push_back(p);
+        }
+    }
+}
+
+bool CustomerCones::reachable(uint32_t src, uint32_t dst) const {
+    // Every valley-free path from src turns at some AS u above src: dst is in
+    // the cone of u or of one of u's peers
+    std::vector<uint32_t> up;
+    uphill(src, up);
+    for (uint32_t u : up) {
+        if (in_cone(u, dst)) return true;
+        for (uint32_t v : graph->peers[u]) {
+            if (in_cone(v, dst)) return true;
+        }
+    }
+    return false;
+}
+
+std::size_t CustomerCones::reachable_set(uint32_t src, std::vector<uint64_t>& bits) const {
+    bits.assign(num_words, 0);
+    std::vector<uint32_t> up;
+    uphill(src, up);
+    for (uint32_t u : up) {
+        cones[u].or_into(bits.data());
+        for (uint32_t v : graph->peers[u]) cones[v].or_into(bits.data());
+    }
+    std::size_t count = 0;
+    for (uint64_t word : bits) count += static_cast<std::size_t>(std::popcount(word));
+    return count;
+}
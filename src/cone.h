@@ -0,0 +1,71 @@
+// Customer cones - every AS with all its direct and indirect customers, as compressed node sets
+// Built bottom-up over the rank layers by OR-ing the customers' sets; answers cone and valley-free reachability queries
+#pragma once
+
+#include "as_graph.h"
+#include "thread_pool.h"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Set of node indices: a sorted array while small, a dense bitmap over all
+// nodes once the array would take more memory than the bitmap (the two
+// container kinds of a roaring bitmap, with one container for the whole set)
+class NodeSet {
+public:
+    std::size_t size() const { return count; }
+    bool dense() const { return !bits.empty(); }
+    bool contains(uint32_t node) const;
+    // Sets the members' bits in a dense bitmap over all nodes
+    void or_into(uint64_t* words) const;
+    std::size_t memory_bytes() const { return items.capacity() * sizeof(uint32_t) + bits.capacity() * sizeof(uint64_t); }
+
+    // Calls fn(node) for every member in index order
+    template <typename Func>
+    void for_each(Func&& fn) const {
+        for (uint32_t node : items) fn(node);
+        for (std::size_t w = 0; w < bits.size(); ++w) {
+            for (uint64_t word = bits[w]; word; word &= word - 1) {
+                fn(static_cast<uint32_t>((w << 6) | std::countr_zero(word)));
+            }
+        }
+    }
+
+private:
+    friend class CustomerCones;
+    std::size_t count = 0;
+    std::vector<uint32_t> items;  // sorted, while sparse
+    std::vector<uint64_t> bits;   // one bit per node, once dense
+};
+
+// The customer cone of every node of a graph. A node's cone is itself plus
+// the union of its customers' cones, so cones are built rank by rank from the
+// ASes without customers up; the nodes of one rank are independent and run
+// on the pool. A set switches to a bitmap at 1/32 of the nodes, which bounds
+// a cone to the smaller of 4 bytes per member and one bit per node.
+class CustomerCones {
+public:
+    // ranks as from rank_topology: rank r only has customers in lower ranks
+    void build(const ASGraph& graph, const std::vector<std::vector<uint32_t>>& ranks, ThreadPool& pool);
+
+    const NodeSet& cone(uint32_t node) const { return cones[node]; }
+    bool in_cone(uint32_t node, uint32_t member) const { return cones[node].contains(member); }
+    std::size_t memory_bytes() const;
+
+    // Whether a valley-free path joins src and dst: up through providers, at
+    // most one peer link, then down through customers. Such a path read
+    // backwards is valley-free too, so the relation is symmetric.
+    bool reachable(uint32_t src, uint32_t dst) const;
+    // Sets in bits (resized to one bit per node) every node that src reaches
+    // valley-free, src included; returns their number
+    std::size_t reachable_set(uint32_t src, std::vector<uint64_t>& bits) const;
+
+private:
+    // src and its direct and indirect providers, in no particular order
+    void uphill(uint32_t src, std::vector<uint32_t>& out) const;
+
+    const ASGraph* graph = nullptr;
+    std::size_t num_words = 0;
+    std::vector<NodeSet> cones;
+};
@@ -0,0 +1,164 @@
+#include "fib.h"
+#include <algorithm>
+#include <charconv>
+
+void append_ipv4(std::string& out, uint32_t addr) {
+    char buf[4];
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.append(buf, std::to_chars(buf, buf + sizeof(buf), (addr >> shift) & 0xFF).ptr);
+        if (shift > 0) out.push_back('.');
+    }
+}
+
+std::string_view outcome_name(ForwardOutcome outcome) {
+    switch (outcome) {
+    case ForwardOutcome::DELIVERED: return "delivered";
+    case ForwardOutcome::NO_ROUTE: return "no-route";
+    case ForwardOutcome::LOOP: return "loop";
+    case ForwardOutcome::UNKNOWN_AS: return "unknown-as";
+    }
+    return "";
+}
+
+std::size_t ForwardingTable::build() {
+    struct Entry {
+        uint32_t addr;
+        uint8_t len;
+        PrefixID id;
+    };
+    std::vector<Entry> entries;
+    entries.reserve(store.num_prefixes());
+    for (PrefixID id = 0; id < store.num_prefixes(); ++id) {
+        PrefixKey key;
+        if (!parse_prefix(store.prefix(id), key) || key.family != 4) continue;
+        const auto addr = static_cast<uint32_t>(key.lo);
+        entries.push_back({key.len < 32 ? addr & ~(UINT32_MAX >> key.len) : addr, key.len, id});
+    }
+    // Shorter prefixes first, so longer ones overwrite the ranges they split
+    // and every prefix finds its parent by a lookup of its own address.
+    // Prefixes of one range are adjacent, lowest PrefixID first.
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        if (a.len != b.len) return a.len < b.len;
+        return a.addr != b.addr ? a.addr < b.addr : a.id < b.id;
+    });
+
+    arena.release();
+    tbl24 = arena.allocate<uint32_t>(std::size_t{1} << 24);  // fresh mapping: all zero
+    tbl8.clear();
+    parents.assign(store.num_prefixes(), kNoPrefix);
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        const Entry& e = entries[i];
+        if (i > 0 && entries[i - 1].len == e.len && entries[i - 1].addr == e.addr) {
+            // Same range as the previous prefix, which keeps it: e is linked
+            // in after it, so ASes without a route for it still try e
+            PrefixID& prev_parent = parents[entries[i - 1].id];
+            parents[e.id] = prev_parent;
+            prev_parent = e.id;
+            continue;
+        }
+        parents[e.id] = lookup(e.addr);
+        const uint32_t value = e.id + 1;
+        if (e.len <= 24) {
+            std::fill_n(tbl24 + (e.addr >> 8), std::size_t{1} << (24 - e.len), value);
+            continue;
+        }
+        // Split the /24: its group starts out with the /24's current entry
+        uint32_t& top = tbl24[e.addr >> 8];
+        if (!(top & kGroupBit)) {
+            const uint32_t group = static_cast<uint32_t>(tbl8.size() >> 8);
+            tbl8.resize(tbl8.size() + 256, top);
+            top = kGroupBit | group;
+        }
+        std::fill_n(tbl8.begin() + ((std::size_t{top & ~kGroupBit} << 8) | (e.addr & 0xFF)),
+                    std::size_t{1} << (32 - e.len), value);
+    }
+
+    // A hop then costs one route search, not a node search and two path reads
+    next_nodes.clear();
+    next_nodes.reserve(store.num_routes());
+    store.for_each_route([&](uint32_t, PrefixID, std::span<const uint32_t> path) {
+        next_nodes.push_back(path.empty() ? kOrigin : store.find_node(path.front()));
+    });
+    return entries.size();
+}
+
+PrefixID ForwardingTable::route_for(uint32_t node, uint32_t addr, uint64_t& route) const {
+    PrefixID prefix_id = lookup(addr);
+    while (prefix_id != kNoPrefix && (route = store.find_route(node, prefix_id)) == ResultStore::kNoRoute) {
+        prefix_id = parent(prefix_id);
+    }
+    return prefix_id;
+}
+
+ForwardOutcome ForwardingTable::forward(uint32_t node, uint32_t addr, std::vector<ASN>& hops,
+                                        PrefixID& prefix) const {
+    hops.clear();
+    hops.push_back(store.node_asn(node));
+    uint64_t route = ResultStore::kNoRoute;
+    prefix = route_for(node, addr, route);
+    PrefixID hop_prefix = prefix;
+    for (;;) {
+        if (hop_prefix == kNoPrefix) return ForwardOutcome::NO_ROUTE;
+        const uint32_t next = next_nodes[route];
+        if (next == kOrigin) return ForwardOutcome::DELIVERED;
+        if (next == ResultStore::kNotFound) {
+            // Stores written with --only-asns lack the other ASes
+            std::span<const uint32_t> path;
+            store.route(node, hop_prefix, path);
+            hops.push_back(path.front());
+            return ForwardOutcome::UNKNOWN_AS;
+        }
+        const ASN next_asn = store.node_asn(next);
+        const bool seen = std::find(hops.begin(), hops.end(), next_asn) != hops.end();
+        hops.push_back(next_asn);
+        if (seen) return ForwardOutcome::LOOP;
+        node = next;
+        hop_prefix = route_for(node, addr, route);
+    }
+}
+void append_forward_row(std::string& out, const ResultStore& store, const ForwardQuery& query, PrefixID prefix,
+                        std::span<const ASN> hops, ForwardOutcome outcome) {
+    char buf[10];
+    out.append(buf, std::to_chars(buf, buf + sizeof(buf), query.asn).ptr);
+    out.push_back(',');
+    append_ipv4(out, query.addr);
+    out.push_back(',');
+    if (prefix != ForwardingTable::kNoPrefix) out.append(store.prefix(prefix));
+    out.push_back(',');
+    for (std::size_t i = 0; i < hops.size(); ++i) {
+        if (i > 0) out.push_back('-');
+        out.append(buf, std::to_chars(buf, buf + sizeof(buf), hops[i]).ptr);
+    }
+    out.push_back(',');
+    out.append(outcome_name(outcome));
+    out.push_back('\n');
+}
+
+void forward_batch(OutputSink& sink, const ResultStore& store, const ForwardingTable& table,
+                   std::span<const ForwardQuery> queries, ThreadPool& pool) {
+    constexpr std::size_t kQueriesPerBlock = 16384;
+    constexpr std::size_t kBlocksPerRound = 2;  // per thread
+    const std::size_t num_blocks = (queries.size() + kQueriesPerBlock - 1) / kQueriesPerBlock;
+    const std::size_t round = std::size_t{pool.size()} * kBlocksPerRound;
+    std::vector<std::string> buffers(std::min(round, num_blocks));
+    for (std::size_t first = 0; first < num_blocks; first += round) {
+        const std::size_t count = std::min(round, num_blocks - first);
+        pool.parallel_for(count, [](std::size_t) { return 1; }, [&](std::size_t i) {
+            const std::span<const ForwardQuery> block =
+                queries.subspan((first + i) * kQueriesPerBlock).first(
+                    std::min(kQueriesPerBlock, queries.size() - (first + i) * kQueriesPerBlock));
+            std::string& buf = buffers[i];
+            buf.clear();
+            std::vector<ASN> hops;
+            for (const ForwardQuery& query : block) {
+                const uint32_t node = store.find_node(query.asn);
+                PrefixID prefix = ForwardingTable::kNoPrefix;
+                ForwardOutcome outcome = ForwardOutcome::UNKNOWN_AS;
+                hops.clear();
+                if (node != ResultStore::kNotFound) outcome = table.forward(node, query.addr, hops, prefix);
+                append_forward_row(buf, store, query, prefix, hops, outcome);
+            }
+        });
+        for (std::size_t i = 0; i < count; ++i) sink.write(buffers[i]);
+    }
+}
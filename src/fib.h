@@ -0,0 +1,99 @@
+// Forwarding table - longest-prefix match over the IPv4 prefixes of a result store (DIR-24-8) and data-plane paths
+// One match table serves every AS: an AS without a route for the longest match falls back to the covering prefixes
+#pragma once
+
+#include "allocator.h"
+#include "result_store.h"
+#include "rib_writer.h"
+#include "scenario.h"
+#include "thread_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Appends addr in dotted-quad form
+void append_ipv4(std::string& out, uint32_t addr);
+
+// What became of a packet followed hop by hop
+enum class ForwardOutcome : uint8_t { DELIVERED, NO_ROUTE, LOOP, UNKNOWN_AS };
+
+// "delivered", "no-route", "loop" or "unknown-as"
+std::string_view outcome_name(ForwardOutcome outcome);
+
+// Longest-prefix match over the store's prefixes plus the next hop of every
+// route. The match is a DIR-24-8 table: 2^24 first-level entries indexed by
+// the top 24 bits of an address, plus a 256-entry group for every /24 that a
+// longer prefix splits. An entry is 0 (no prefix), prefix_id + 1, or a group
+// index with kGroupBit. The first level sits in a fresh mapping, so only the
+// pages that prefixes cover are ever committed.
+class ForwardingTable {
+public:
+    static constexpr PrefixID kNoPrefix = UINT32_MAX;
+
+    explicit ForwardingTable(const ResultStore& store)
+        : store(store), arena(std::size_t{sizeof(uint32_t)} << 24) {}
+
+    // Indexes every IPv4 prefix of the store (other prefixes are never
+    // matched) and resolves every route's next hop; returns the number of
+    // prefixes indexed. Prefixes are parsed like the announcements
+    // (parse_prefix) and match on their network bits, so 10.0.0.1/8 and
+    // 10.0.0.0/8 cover the same range: the lowest PrefixID of such prefixes
+    // is the one lookup returns, the others follow it in the parent chain.
+    std::size_t build();
+
+    // Longest prefix that contains addr, kNoPrefix if none
+    PrefixID lookup(uint32_t addr) const {
+        const uint32_t entry = tbl24[addr >> 8];
+        if (entry & kGroupBit) return tbl8[(std::size_t{entry & ~kGroupBit} << 8) | (addr & 0xFF)] - 1;
+        return entry - 1;
+    }
+    // Next prefix to fall back to from prefix_id: the next higher PrefixID
+    // covering the same range, else the longest prefix of the table that
+    // strictly contains it; kNoPrefix if none
+    PrefixID parent(PrefixID prefix_id) const { return parents[prefix_id]; }
+
+    // Route that node uses for addr: its route (store route index) to the
+    // longest prefix containing addr that it has a route for. Returns that
+    // prefix, kNoPrefix if there is none.
+    PrefixID route_for(uint32_t node, uint32_t addr, uint64_t& route) const;
+
+    // Follows a packet for addr from node: every AS looks up its own route (a
+    // more specific prefix can pull traffic off the source's AS path) and
+    // hands the packet to that route's next hop. hops gets the ASNs visited,
+    // node first; prefix the prefix matched at node. Ends where an AS
+    // originates the matched prefix, has no route, an AS repeats, or the next
+    // hop is not in the store.
+    ForwardOutcome forward(uint32_t node, uint32_t addr, std::vector<ASN>& hops, PrefixID& prefix) const;
+
+private:
+    static constexpr uint32_t kGroupBit = uint32_t{1} << 31;
+    static constexpr uint32_t kOrigin = UINT32_MAX - 1;  // next_nodes entry of a route the AS originates
+
+    const ResultStore& store;
+    Arena arena;
+    uint32_t* tbl24 = nullptr;
+    std::vector<uint32_t> tbl8;        // 256 entries per group
+    std::vector<PrefixID> parents;     // per prefix of the store
+    std::vector<uint32_t> next_nodes;  // per route: store node of the next hop, kOrigin or kNotFound
+};
+
+// One (source AS, destination address) query of a batch
+struct ForwardQuery {
+    ASN asn;
+    uint32_t addr;
+};
+
+// Appends "asn,address,prefix,path,outcome": the path is the hops of
+// forward(), dash-separated; prefix is empty if the source has no route
+void append_forward_row(std::string& out, const ResultStore& store, const ForwardQuery& query, PrefixID prefix,
+                        std::span<const ASN> hops, ForwardOutcome outcome);
+
+// Follows every query and writes its row to sink, in query order. Blocks of
+// queries are resolved on the pool into per-block buffers a round at a time,
+// so memory stays bounded however many queries there are. A source AS that is
+// not in the store gets outcome unknown-as and an empty path.
+void forward_batch(OutputSink& sink, const ResultStore& store, const ForwardingTable& table,
+                   std::span<const ForwardQuery> queries, ThreadPool& pool);
@@ -0,0 +1,245 @@
+#include "graph_snapshot.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File layout: header, then uint32 sections (each padded to 8 bytes) in this order:
+//   asn[num_nodes], rank[num_nodes],
+//   index_asn[num_nodes], index_node[num_nodes]   (ASN index sorted by ASN)
+//   {provider, customer, peer}: offsets[num_nodes + 1], targets[num_edges]
+//   rank_offsets[num_ranks + 1], rank_nodes[num_ranked]
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t source_hash;
+    uint64_t num_nodes;
+    uint64_t num_ranks;
+    uint64_t num_ranked;
+    uint64_t num_edges[3];  // providers, customers, peers
+};
+
+static constexpr char kMagic[8] = {'B', 'G', 'P', 'G', 'R', 'A', 'P', 'H'};
+
+static inline std::size_t padded(std::size_t words) { return (words + 1) & ~std::size_t{1}; }
+
+// Whether offsets[0..count] rise monotonically from 0 to total
+static bool valid_offsets(const uint32_t* offsets, std::size_t count, uint64_t total) {
+    if (offsets[0] != 0 || offsets[count] != total) return false;
+    for (std::size_t i = 0; i < count; ++i) {
+        if (offsets[i] > offsets[i + 1]) return false;
+    }
+    return true;
+}
+
+// Whether all count entries of indices are node indices below n
+static bool valid_indices(const uint32_t* indices, std::size_t count, std::size_t n) {
+    return std::all_of(indices, indices + count, [n](uint32_t idx) { return idx < n; });
+}
+
+// Whether every node has a rank below num_ranks (snapshots only hold acyclic
+// graphs, so there are no unranked nodes) and every node listed under rank r
+// has rank r
+static bool valid_ranks(const uint32_t* node_ranks, std::size_t n, const uint32_t* rank_offsets,
+                        const uint32_t* rank_nodes, std::size_t num_ranks) {
+    if (!std::all_of(node_ranks, node_ranks + n, [num_ranks](uint32_t r) { return r < num_ranks; })) return false;
+    for (std::size_t r = 0; r < num_ranks; ++r) {
+        for (uint32_t i = rank_offsets[r]; i < rank_offsets[r + 1]; ++i) {
+            if (node_ranks[rank_nodes[i]] != r) return false;
+        }
+    }
+    return true;
+}
+
+bool hash_file(const std::string& path, uint64_t& hash) {
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) return false;
+    // Word-wise multiply/rotate hash; the length is mixed in at the end
+    uint64_t h = 0x9E3779B97F4A7C15ull;
+    uint64_t length = 0;
+    std::vector<unsigned char> buf(1 << 20);
+    std::size_t n;
+    while ((n = fread(buf.data(), 1, buf.size(), fp)) > 0) {
+        length += n;
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            uint64_t w;
+            std::memcpy(&w, buf.data() + i, 8);
+            h = (h ^ (w * 0xFF51AFD7ED558CCDull)) * 0xC4CEB9FE1A85EC53ull;
+            h = (h << 29) | (h >> 35);
+        }
+        for (; i < n; ++i) {
+            h = (h ^ buf[i]) * 0x100000001B3ull;
+        }
+    }
+    bool ok = !ferror(fp);
+    fclose(fp);
+    h ^= length;
+    h = (h ^ (h >> 33)) * 0xFF51AFD7ED558CCDull;
+    hash = h ^ (h >> 33);
+    return ok;
+}
+
+bool save_graph_snapshot(const std::string& path, const ASGraph& graph,
+                         const std::vector<std::vector<uint32_t>>& ranks, uint64_t source_hash) {
+    const std::size_t n = graph.nodes.size();
+    SnapshotHeader hdr{};
+    std::memcpy(hdr.magic, kMagic, sizeof(kMagic));
+    hdr.version = kGraphSnapshotVersion;
+    hdr.source_hash = source_hash;
+    hdr.num_nodes = n;
+    hdr.num_ranks = ranks.size();
+    for (const auto& r : ranks) hdr.num_ranked += r.size();
+
+    std::vector<uint32_t> data;
+    auto append = [&data](const std::vector<uint32_t>& section) {
+        data.insert(data.end(), section.begin(), section.end());
+        if (section.size() % 2) data.push_back(0);
+    };
+
+    std::vector<uint32_t> section(n);
+    for (std::size_t i = 0; i < n; ++i) section[i] = graph.nodes[i].asn;
+    append(section);
+    for (std::size_t i = 0; i < n; ++i) section[i] = static_cast<uint32_t>(graph.nodes[i].rank);
+    append(section);
+
+    std::vector<uint32_t> order(n);
+    for (std::size_t i = 0; i < n; ++i) order[i] = static_cast<uint32_t>(i);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return graph.nodes[a].asn < graph.nodes[b].asn;
+    });
+    for (std::size_t i = 0; i < n; ++i) section[i] = graph.nodes[order[i]].asn;
+    append(section);
+    append(order);
+
+    const Adjacency* lists[3] = {&graph.providers, &graph.customers, &graph.peers};
+    for (int rel = 0; rel < 3; ++rel) {
+        std::vector<uint32_t> offsets(n + 1, 0);
+        if (n > 0) offsets.assign(lists[rel]->offsets(), lists[rel]->offsets() + n + 1);
+        std::vector<uint32_t> targets(lists[rel]->targets(), lists[rel]->targets() + offsets[n]);
+        hdr.num_edges[rel] = targets.size();
+        append(offsets);
+        append(targets);
+    }
+
+    std::vector<uint32_t> rank_offsets(ranks.size() + 1, 0);
+    std::vector<uint32_t> rank_nodes;
+    rank_nodes.reserve(hdr.num_ranked);
+    for (std::size_t r = 0; r < ranks.size(); ++r) {
+        rank_nodes.insert(rank_nodes.end(), ranks[r].begin(), ranks[r].end());
+        rank_offsets[r + 1] = static_cast<uint32_t>(rank_nodes.size());
+    }
+    append(rank_offsets);
+    append(rank_nodes);
+
+    // Per-process name: concurrent runs that both missed the cache must not
+    // write into the same file
+    const std::string tmp_path = path + "." + std::to_string(::getpid()) + ".tmp";
+    FILE* fp = fopen(tmp_path.c_str(), "wb");
+    if (!fp) return false;
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+              fwrite(data.data(), sizeof(uint32_t), data.size(), fp) == data.size();
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool load_graph_snapshot(const std::string& path, uint64_t source_hash, ASGraph& graph,
+                         std::vector<std::vector<uint32_t>>& ranks) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+    const std::size_t file_size = static_cast<std::size_t>(st.st_size);
+    void* map = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    // The adjacency arrays are used in place, so the mapping lives as long as the graph
+    std::shared_ptr<const void> mapping(map, [file_size](const void* p) {
+        munmap(const_cast<void*>(p), file_size);
+    });
+
+    bool ok = false;
+    const auto* hdr = static_cast<const SnapshotHeader*>(map);
+    const uint32_t* cur = reinterpret_cast<const uint32_t*>(hdr + 1);
+    const uint32_t* end = reinterpret_cast<const uint32_t*>(static_cast<const char*>(map) + file_size);
+    // Hands out the next section, or nullptr if it would run past the end of the file
+    auto take = [&](std::size_t words) -> const uint32_t* {
+        if (!cur || static_cast<std::size_t>(end - cur) < padded(words)) return cur = nullptr;
+        const uint32_t* section = cur;
+        cur += padded(words);
+        return section;
+    };
+
+    // Node indices, offsets and counts are uint32 on disk; larger header values
+    // could only come from a corrupt file, and keeping them small keeps the
+    // section sizes in take() from overflowing
+    const bool counts_fit = hdr->num_nodes < UINT32_MAX && hdr->num_ranks < UINT32_MAX &&
+                            hdr->num_ranked <= UINT32_MAX && hdr->num_edges[0] <= UINT32_MAX &&
+                            hdr->num_edges[1] <= UINT32_MAX && hdr->num_edges[2] <= UINT32_MAX;
+    if (std::memcmp(hdr->magic, kMagic, sizeof(kMagic)) == 0 && hdr->version == kGraphSnapshotVersion &&
+        hdr->source_hash == source_hash && counts_fit) {
+        const std::size_t n = hdr->num_nodes;
+        const uint32_t* asns = take(n);
+        const uint32_t* node_ranks = take(n);
+        const uint32_t* index_asn = take(n);
+        const uint32_t* index_node = take(n);
+        const uint32_t* offsets[3];
+        const uint32_t* targets[3];
+        for (int rel = 0; rel < 3; ++rel) {
+            offsets[rel] = take(n + 1);
+            targets[rel] = take(hdr->num_edges[rel]);
+        }
+        const uint32_t* rank_offsets = take(hdr->num_ranks + 1);
+        const uint32_t* rank_nodes = take(hdr->num_ranked);
+
+        // Range checks on every index section before trusting them: a damaged
+        // file falls back to the CAIDA load instead of indexing out of bounds
+        if (cur) {
+            bool valid = valid_indices(index_node, n, n) &&
+                         valid_offsets(rank_offsets, hdr->num_ranks, hdr->num_ranked) &&
+                         valid_indices(rank_nodes, hdr->num_ranked, n) &&
+                         valid_ranks(node_ranks, n, rank_offsets, rank_nodes, hdr->num_ranks);
+            for (int rel = 0; rel < 3 && valid; ++rel) {
+                valid = valid_offsets(offsets[rel], n, hdr->num_edges[rel]) &&
+                        valid_indices(targets[rel], hdr->num_edges[rel], n);
+            }
+            if (!valid) cur = nullptr;
+        }
+
+        if (cur) {
+            graph.nodes.assign(n, ASNode{});
+            graph.asn_to_index.clear();
+            graph.asn_to_index.reserve(n);
+            for (std::size_t i = 0; i < n; ++i) {
+                ASNode& node = graph.nodes[i];
+                node.asn = asns[i];
+                node.rank = static_cast<int>(node_ranks[i]);
+                graph.asn_to_index.emplace(index_asn[i], index_node[i]);
+            }
+            Adjacency* lists[3] = {&graph.providers, &graph.customers, &graph.peers};
+            for (int rel = 0; rel < 3; ++rel) {
+                lists[rel]->view(offsets[rel], targets[rel]);
+            }
+            graph.storage = std::move(mapping);
+            ranks.assign(hdr->num_ranks, {});
+            for (std::size_t r = 0; r < hdr->num_ranks; ++r) {
+                ranks[r].assign(rank_nodes + rank_offsets[r], rank_nodes + rank_offsets[r + 1]);
+            }
+            ok = true;
+        }
+    }
+
+    return ok;
+}
@@ -0,0 +1,27 @@
+// Graph snapshot - versioned binary image of a preprocessed ASGraph
+// Holds nodes, ASN index, adjacency and ranks; tagged with a hash of the CAIDA source file
+#pragma once
+
+#include "as_graph.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Bump whenever the on-disk layout or the meaning of a section changes
+constexpr uint32_t kGraphSnapshotVersion = 2;
+
+// 64-bit content hash of a file (read in large blocks); false if it cannot be read
+bool hash_file(const std::string& path, uint64_t& hash);
+
+// Writes graph and ranks to path (via a temporary file and rename, so readers
+// never see a partial snapshot). Only call this for acyclic graphs.
+bool save_graph_snapshot(const std::string& path, const ASGraph& graph,
+                         const std::vector<std::vector<uint32_t>>& ranks, uint64_t source_hash);
+
+// Maps a snapshot and fills graph and ranks from it; the adjacency is used in
+// place from the mapping (kept alive by graph.storage). Returns false (leaving
+// graph untouched) if the file is missing, truncated, from another format
+// version, was built from a source with a different hash, has an offset or
+// node index out of range, or has node ranks that disagree with the rank lists.
+bool load_graph_snapshot(const std::string& path, uint64_t source_hash, ASGraph& graph,
+                         std::vector<std::vector<uint32_t>>& ranks);
@@ -0,0 +1,170 @@
+#include "incremental.h"
+#include "propagation.h"
+#include <algorithm>
+#include <iostream>
+
+bool baseline_usable(const ResultStore& baseline, const ASGraph& graph, const AsnLookup& lookup,
+                     uint64_t source_hash) {
+    if (baseline.source_hash() != source_hash) {
+        std::cerr << "Baseline result store was computed on another CAIDA file\n";
+        return false;
+    }
+    bool complete = baseline.num_nodes() == graph.nodes.size();
+    for (uint32_t k = 0; complete && k < baseline.num_nodes(); ++k) {
+        complete = lookup.find(baseline.node_asn(k)) != AsnLookup::kNotFound;
+    }
+    if (!complete) {
+        std::cerr << "Baseline result store does not hold the routes of every AS (written with --only-asns?)\n";
+        return false;
+    }
+    return true;
+}
+
+// Groups rows by prefix, keeping input order within a prefix: the rows of
+// prefix p are grouped[offsets[p] .. offsets[p + 1])
+static void group_by_prefix(std::span<const AnnRow> rows, std::size_t num_prefixes,
+                            std::vector<uint32_t>& offsets, std::vector<AnnRow>& grouped) {
+    offsets.assign(num_prefixes + 1, 0);
+    for (const AnnRow& row : rows) ++offsets[row.prefix_id + 1];
+    for (std::size_t p = 0; p < num_prefixes; ++p) offsets[p + 1] += offsets[p];
+    grouped.resize(rows.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (const AnnRow& row : rows) grouped[fill[row.prefix_id]++] = row;
+}
+
+std::vector<char> affected_prefixes(const ResultStore& baseline, const std::vector<std::string>& prefixes,
+                                    std::span<const AnnRow> anns, std::span<const ASN> rov_asns) {
+    std::vector<uint32_t> new_offsets, old_offsets;
+    std::vector<AnnRow> new_rows, old_rows;
+    group_by_prefix(anns, prefixes.size(), new_offsets, new_rows);
+    group_by_prefix(baseline.anns(), baseline.num_prefixes(), old_offsets, old_rows);
+
+    std::vector<char> affected(prefixes.size(), 0);
+    for (PrefixID p = 0; p < prefixes.size(); ++p) {
+        const uint32_t old_id = baseline.find_prefix(prefixes[p]);
+        if (old_id == ResultStore::kNotFound) {
+            affected[p] = 1;
+            continue;
+        }
+        const uint32_t count = new_offsets[p + 1] - new_offsets[p];
+        if (count != old_offsets[old_id + 1] - old_offsets[old_id]) {
+            affected[p] = 1;
+            continue;
+        }
+        for (uint32_t i = 0; i < count; ++i) {
+            const AnnRow& a = new_rows[new_offsets[p] + i];
+            const AnnRow& b = old_rows[old_offsets[old_id] + i];
+            if (a.asn != b.asn || a.rov_invalid != b.rov_invalid) {
+                affected[p] = 1;
+                break;
+            }
+        }
+    }
+
+    // A changed ROV set only matters where something can be dropped
+    const std::span<const ASN> old_rov = baseline.rov_asns();
+    if (!std::equal(rov_asns.begin(), rov_asns.end(), old_rov.begin(), old_rov.end())) {
+        for (const AnnRow& row : anns) {
+            if (row.rov_invalid) affected[row.prefix_id] = 1;
+        }
+    }
+    return affected;
+}
+
+// Relationship of hop as seen by idx. With duplicate relationships for a pair
+// the customer route is preferred, as it is during propagation.
+static Rel relation_to(const ASGraph& graph, uint32_t idx, uint32_t hop) {
+    auto contains = [hop](std::span<const uint32_t> list) {
+        return std::binary_search(list.begin(), list.end(), hop);
+    };
+    if (contains(graph.customers[idx])) return CUST;
+    if (contains(graph.peers[idx])) return PEER;
+    return PROV;
+}
+
+std::size_t resimulate(const ResultStore& baseline, const ASGraph& graph,
+                       const std::vector<std::vector<uint32_t>>& ranks, const AsnLookup& lookup,
+                       std::vector<BGPState>& states, const std::vector<std::string>& prefixes,
+                       std::span<const AnnRow> anns, const std::vector<char>& affected, ThreadPool& pool,
+                       PropagationStats* stats) {
+    // Baseline prefix ID -> new prefix ID for every prefix that is restored
+    std::vector<PrefixID> restored(baseline.num_prefixes(), ResultStore::kNotFound);
+    std::vector<PrefixID> local_to_global;
+    std::vector<PrefixID> global_to_local(prefixes.size(), ResultStore::kNotFound);
+    for (PrefixID p = 0; p < prefixes.size(); ++p) {
+        if (affected[p]) {
+            global_to_local[p] = static_cast<PrefixID>(local_to_global.size());
+            local_to_global.push_back(p);
+        } else {
+            restored[baseline.find_prefix(prefixes[p])] = p;
+        }
+    }
+
+    // ROV flag of the route each origin injected (its last row for the prefix)
+    std::vector<uint32_t> origin_offsets;
+    std::vector<AnnRow> origin_rows;
+    group_by_prefix(anns, prefixes.size(), origin_offsets, origin_rows);
+    auto origin_invalid = [&](PrefixID p, ASN origin) {
+        for (uint32_t i = origin_offsets[p + 1]; i > origin_offsets[p]; --i) {
+            if (origin_rows[i - 1].asn == origin) return origin_rows[i - 1].rov_invalid != 0;
+        }
+        return false;
+    };
+
+    // Each stored path is the next-hop chain of the RIB entry that produced it,
+    // so the entry follows from its first and last hop
+    pool.parallel_for(baseline.num_nodes(), [](std::size_t) { return 1; }, [&](std::size_t k) {
+        const uint32_t node = static_cast<uint32_t>(k);
+        const ASN asn = baseline.node_asn(node);
+        const uint32_t idx = lookup.find(asn);
+        // An AS uses few distinct next hops, usually in runs
+        ASN last_hop = 0;
+        Rel last_rel = ORIGIN;
+        baseline.for_each_route_of(node, [&](uint32_t, PrefixID old_id, std::span<const uint32_t> path) {
+            const PrefixID p = restored[old_id];
+            if (p == ResultStore::kNotFound) return;
+            Announcement ann;
+            if (path.empty()) {
+                ann.next_hop = asn;
+                ann.rel = ORIGIN;
+            } else {
+                if (last_rel == ORIGIN || path.front() != last_hop) {
+                    last_hop = path.front();
+                    last_rel = relation_to(graph, idx, lookup.find(last_hop));
+                }
+                ann.next_hop = last_hop;
+                ann.rel = last_rel;
+            }
+            ann.path_len = static_cast<uint16_t>(path.size() + 1);
+            ann.rov_invalid = origin_invalid(p, path.empty() ? asn : path.back());
+            bgp_originate(states[idx], p, ann);
+        });
+    });
+
+    if (local_to_global.empty()) return 0;
+
+    // Affected prefixes run on their own table with compact IDs, then are
+    // copied into their global slots
+    std::vector<BGPState> delta = states;
+    BGPTable delta_table;
+    delta_table.init(delta, local_to_global.size());
+    for (const AnnRow& row : anns) {
+        const PrefixID local = global_to_local[row.prefix_id];
+        if (local == ResultStore::kNotFound) continue;
+        Announcement ann;
+        ann.next_hop = row.asn;
+        ann.path_len = 1;
+        ann.rel = ORIGIN;
+        ann.rov_invalid = row.rov_invalid != 0;
+        bgp_originate(delta[lookup.find(row.asn)], local, ann);
+    }
+    propagate(graph, ranks, delta, pool, stats);
+
+    pool.parallel_for(states.size(), [&](std::size_t i) { return 1 + delta[i].num_routes; }, [&](std::size_t i) {
+        const BGPState& from = delta[i];
+        for_each_prefix(from.rib_present, from.prefix_words, [&](PrefixID local) {
+            bgp_originate(states[i], local_to_global[local], from.rib[local]);
+        });
+    });
+    return local_to_global.size();
+}
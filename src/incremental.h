@@ -0,0 +1,37 @@
+// Incremental re-simulation - reruns only the prefixes an input delta can affect
+// Every other prefix is restored from the result store of a baseline run on the same graph
+#pragma once
+
+#include "as_graph.h"
+#include "bgp.h"
+#include "propagation.h"
+#include "result_store.h"
+#include "rib_writer.h"
+#include "thread_pool.h"
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+// True if baseline was written for this graph (same CAIDA file hash) and holds
+// the routes of every AS, i.e. without --only-asns; prints the reason otherwise
+bool baseline_usable(const ResultStore& baseline, const ASGraph& graph, const AsnLookup& lookup,
+                     uint64_t source_hash);
+
+// Marks the prefixes (new PrefixIDs) whose routes may differ from the baseline:
+// prefixes the baseline did not simulate, prefixes whose announcement rows
+// (origin, ROV flag, input order) changed and, if the set of ROV ASes changed,
+// every prefix with a ROV-invalid announcement. rov_asns lists the ROV ASes of
+// the graph in ascending order.
+std::vector<char> affected_prefixes(const ResultStore& baseline, const std::vector<std::string>& prefixes,
+                                    std::span<const AnnRow> anns, std::span<const ASN> rov_asns);
+
+// Fills states (bound to a table with one slot per new prefix) with the
+// converged routes: unaffected prefixes are rebuilt from the baseline's AS
+// paths, affected ones are propagated from their announcements. Returns the
+// number of prefixes propagated.
+std::size_t resimulate(const ResultStore& baseline, const ASGraph& graph,
+                       const std::vector<std::vector<uint32_t>>& ranks, const AsnLookup& lookup,
+                       std::vector<BGPState>& states, const std::vector<std::string>& prefixes,
+                       std::span<const AnnRow> anns, const std::vector<char>& affected, ThreadPool& pool,
+                       PropagationStats* stats = nullptr);
@@ -1,18 +1,37 @@
+// Scratch pool - per-thread arena for short-lived arrays (chunk bounds, cost prefix sums, row counts)
+// An array is returned to its thread's pool when it goes out of scope; the memory stays mapped for the next call
 #pragma once
-#include <vector>
-#include <cstdint>
-template<typename T, size_t CAP = 1<<20>
-class RingMempool {
-  alignas(64) char pool[sizeof(T)*CAP];
-  uint32_t head = 0, tail = 0;
+
+#include "allocator.h"
+#include <cstddef>
+
+// The calling thread's scratch arena; pool threads keep theirs for their lifetime
+inline Arena& scratch_arena() {
+    thread_local Arena arena(std::size_t{1} << 20);
+    return arena;
+}
+
+// Uninitialized array of n T from the thread's scratch arena. Arrays of one
+// thread must be destroyed in reverse order of creation (scoped locals are).
+template <typename T>
+class ScratchArray {
 public:
-  T* alloc() {
-    if (head != tail) {
-      T* ptr = reinterpret_cast<T*>(pool + (head * sizeof(T)));
-      head = (head + 1) % CAP;
-      return ptr;
-    }
-    return nullptr; // full
-  }
-  void reset() { head = tail = 0; }
+    explicit ScratchArray(std::size_t n)
+        : arena(scratch_arena()), saved(arena.mark()), ptr(arena.allocate<T>(n)), count(n) {}
+    ~ScratchArray() { arena.rewind(saved); }
+
+    ScratchArray(const ScratchArray&) = delete;
+    ScratchArray& operator=(const ScratchArray&) = delete;
+
+    T& operator[](std::size_t i) { return ptr[i]; }
+    const T& operator[](std::size_t i) const { return ptr[i]; }
+    T* data() { return ptr; }
+    const T* data() const { return ptr; }
+    std::size_t size() const { return count; }
+
+private:
+    Arena& arena;
+    Arena::Mark saved;
+    T* ptr;
+    std::size_t count;
 };
@@ -0,0 +1,188 @@
+#include "policy.h"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <utility>
+
+uint8_t parse_policy(std::string_view name) {
+    if (name == "rov") return POLICY_ROV;
+    if (name == "customer-only") return POLICY_CUSTOMER_ONLY;
+    if (name == "peer-lock") return POLICY_PEER_LOCK;
+    if (name == "aspa") return POLICY_ASPA;
+    return 0;
+}
+
+static std::string_view trim(std::string_view v) {
+    auto start = v.find_first_not_of(" \t\r\n");
+    if (start == std::string_view::npos) return std::string_view();
+    auto end = v.find_last_not_of(" \t\r\n");
+    return v.substr(start, end - start + 1);
+}
+
+// Calls fn(line_number, first, second) for every "first,second" line of path
+// (comment and blank lines skipped); false if fn returns false or the file
+// cannot be opened
+template <typename Func>
+static bool for_each_pair(const std::string& path, Func&& fn) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        std::cerr << "Cannot open " << path << "\n";
+        return false;
+    }
+    std::string line;
+    for (std::size_t line_no = 1; std::getline(in, line); ++line_no) {
+        std::string_view v = trim(line);
+        if (v.empty() || v[0] == '#') continue;
+        const std::size_t comma = v.find(',');
+        if (comma == std::string_view::npos) {
+            std::cerr << path << ":" << line_no << ": expected two comma-separated fields\n";
+            return false;
+        }
+        if (!fn(line_no, trim(v.substr(0, comma)), trim(v.substr(comma + 1)))) return false;
+    }
+    return true;
+}
+
+static bool parse_asn(std::string_view v, ASN& asn) {
+    auto res = std::from_chars(v.data(), v.data() + v.size(), asn);
+    return res.ec == std::errc() && res.ptr == v.data() + v.size();
+}
+
+bool load_policies(const std::string& path, const ASGraph& graph, std::vector<uint8_t>& policies) {
+    policies.resize(graph.nodes.size(), 0);
+    return for_each_pair(path, [&](std::size_t line_no, std::string_view asn_text, std::string_view name) {
+        ASN asn = 0;
+        const uint8_t policy = parse_policy(name);
+        if (!parse_asn(asn_text, asn) || policy == 0) {
+            std::cerr << path << ":" << line_no << ": expected <asn>,rov|customer-only|peer-lock|aspa\n";
+            return false;
+        }
+        auto it = graph.asn_to_index.find(asn);
+        if (it != graph.asn_to_index.end()) policies[it->second] |= policy;
+        return true;
+    });
+}
+
+bool AspaRecords::load(const std::string& path, const AsnLookup& lookup, std::size_t num_nodes) {
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;  // (customer, provider) node indices
+    published.assign(num_nodes, 0);
+    const bool ok = for_each_pair(path, [&](std::size_t line_no, std::string_view customer_text,
+                                            std::string_view provider_text) {
+        ASN customer_asn = 0, provider_asn = 0;
+        if (!parse_asn(customer_text, customer_asn) || !parse_asn(provider_text, provider_asn)) {
+            std::cerr << path << ":" << line_no << ": expected <customer_asn>,<provider_asn>\n";
+            return false;
+        }
+        const uint32_t customer = lookup.find(customer_asn);
+        if (customer == AsnLookup::kNotFound) return true;
+        published[customer] = 1;
+        // AS0 and providers outside the graph never appear on a path
+        const uint32_t provider = provider_asn == 0 ? AsnLookup::kNotFound : lookup.find(provider_asn);
+        if (provider != AsnLookup::kNotFound) pairs.emplace_back(customer, provider);
+        return true;
+    });
+    if (!ok) return false;
+
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    offsets.assign(num_nodes + 1, 0);
+    for (const auto& [customer, provider] : pairs) ++offsets[customer + 1];
+    for (std::size_t i = 0; i < num_nodes; ++i) offsets[i + 1] += offsets[i];
+    providers.resize(pairs.size());
+    for (std::size_t i = 0; i < pairs.size(); ++i) providers[i] = pairs[i].second;
+    return true;
+}
+
+bool AspaRecords::authorizes(uint32_t customer, uint32_t provider) const {
+    if (!has_record(customer)) return false;
+    const auto first = providers.begin() + offsets[customer];
+    const auto last = providers.begin() + offsets[customer + 1];
+    return std::binary_search(first, last, provider);
+}
+
+namespace {
+
+// ASPA verification of a path given origin first (path[0] is the origin, the
+// last entry is the neighbor the route came from). A hop from customer c to
+// provider p fails only if c published a record without p. Routes from
+// customers and peers must climb all the way; routes from providers may climb
+// and then descend, so a failed hop is fine as long as some apex splits the
+// path into an up ramp and a down ramp without failures.
+bool aspa_invalid(const AspaRecords& aspa, const std::vector<uint32_t>& path, Rel rel) {
+    auto fails = [&](uint32_t customer, uint32_t provider) {
+        return aspa.has_record(customer) && !aspa.authorizes(customer, provider);
+    };
+    const std::size_t n = path.size();
+    if (rel != PROV) {
+        for (std::size_t i = 0; i + 1 < n; ++i) {
+            if (fails(path[i], path[i + 1])) return true;
+        }
+        return false;
+    }
+    std::size_t up = n;  // ASes of the longest up ramp from the origin
+    for (std::size_t i = 0; i + 1 < n; ++i) {
+        if (fails(path[i], path[i + 1])) {
+            up = i + 1;
+            break;
+        }
+    }
+    std::size_t down = n;  // ASes of the longest down ramp ending at the neighbor
+    for (std::size_t j = n - 1; j > 0; --j) {
+        if (fails(path[j], path[j - 1])) {
+            down = n - j;
+            break;
+        }
+    }
+    return up + down < n;
+}
+
+}  // namespace
+
+void mark_path_rejects(const PolicyContext& ctx, const std::vector<BGPState>& states, uint32_t to, uint32_t from,
+                       Rel rel, uint8_t policy, uint64_t* reject) {
+    const BGPState& sender = states[from];
+    const std::span<const uint32_t> peers = ctx.graph->peers[to];
+    const bool peer_lock = (policy & POLICY_PEER_LOCK) && !peers.empty();
+    const bool aspa = (policy & POLICY_ASPA) && ctx.aspa;
+    std::vector<uint32_t> path;  // origin first, the sender last
+
+    for (uint32_t w = 0; w < sender.prefix_words; ++w) {
+        uint64_t bits = sender.rib_present[w];
+        uint64_t rejected = 0;
+        while (bits) {
+            const unsigned b = static_cast<unsigned>(std::countr_zero(bits));
+            bits &= bits - 1;
+            const PrefixID prefix_id = (w << 6) | b;
+            const Announcement& ann = sender.rib[prefix_id];
+
+            // Hops behind the sender, next hop first, as the output rebuilds them.
+            // Every hop advertised this route, so its entry is final and its slot
+            // is not written; its presence word is not read, since a hop in the
+            // step being run may be storing other prefixes of that word.
+            path.clear();
+            bool drop = false;
+            const Announcement* cur = &ann;
+            for (uint16_t hops = 1; cur->rel != ORIGIN && hops < ann.path_len; ++hops) {
+                const uint32_t hop = ctx.lookup->find(cur->next_hop);
+                if (hop == AsnLookup::kNotFound) break;
+                // Peer lock: a peer's routes are only taken from that peer
+                if (peer_lock && std::binary_search(peers.begin(), peers.end(), hop)) {
+                    drop = true;
+                    break;
+                }
+                path.push_back(hop);
+                cur = &states[hop].rib[prefix_id];
+            }
+            if (!drop && aspa) {
+                std::reverse(path.begin(), path.end());
+                path.push_back(from);
+                drop = aspa_invalid(*ctx.aspa, path, rel);
+            }
+            if (drop) rejected |= uint64_t{1} << b;
+        }
+        reject[w] = rejected;
+    }
+}
@@ -0,0 +1,55 @@
+// Routing policies - per-AS import policies (ROV, customer-only, peer lock, ASPA) and the path checks
+// Propagation splits every step by policy class and runs a receive kernel compiled for each class
+#pragma once
+
+#include "as_graph.h"
+#include "bgp.h"
+#include "rib_writer.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// PolicyFlag of a policy name ("rov", "customer-only", "peer-lock", "aspa"), 0 if unknown
+uint8_t parse_policy(std::string_view name);
+
+// Adds the policies of a policies file to policies (PolicyFlag bits, indexed
+// like graph.nodes): one "asn,policy" line each, '#' starts a comment line, and
+// an AS listed more than once combines its policies. ASes outside the graph are
+// skipped. False with a message on stderr if the file cannot be read or names
+// an unknown policy.
+bool load_policies(const std::string& path, const ASGraph& graph, std::vector<uint8_t>& policies);
+
+// Published ASPA records: the providers each customer AS authorizes. An AS
+// without a record makes no statement about its providers.
+class AspaRecords {
+public:
+    // "customer_asn,provider_asn" lines ('#' starts a comment line); provider 0
+    // (AS0) records that the customer has no providers. ASes outside the graph
+    // are skipped. False with a message on stderr if the file cannot be read.
+    bool load(const std::string& path, const AsnLookup& lookup, std::size_t num_nodes);
+
+    bool has_record(uint32_t customer) const { return !published.empty() && published[customer]; }
+    // customer has a record that lists provider (node indices)
+    bool authorizes(uint32_t customer, uint32_t provider) const;
+
+private:
+    std::vector<char> published;       // per node
+    std::vector<uint32_t> offsets;     // per node + 1, into providers
+    std::vector<uint32_t> providers;   // node indices, ascending per customer
+};
+
+// What the peer lock and ASPA checks read besides the RIBs
+struct PolicyContext {
+    const ASGraph* graph = nullptr;
+    const AsnLookup* lookup = nullptr;
+    const AspaRecords* aspa = nullptr;  // null = no records, ASPA rejects nothing
+};
+
+// Sets in reject (one word per bitmap word) the routes in states[from]'s RIB
+// that states[to] drops under the peer lock / ASPA bits of policy when they
+// arrive over rel. AS paths are rebuilt from next hops, so the RIBs along them
+// must be final, as they are whenever to pulls from from during propagation.
+void mark_path_rejects(const PolicyContext& ctx, const std::vector<BGPState>& states, uint32_t to, uint32_t from,
+                       Rel rel, uint8_t policy, uint64_t* reject);
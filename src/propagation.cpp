@@ -0,0 +1,341 @@
+#include "propagation.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <utility>
+
+void StepStats::add(const StepStats& other) {
+    calls += other.calls;
+    ases += other.ases;
+    wall_ns += other.wall_ns;
+    busy_ns += other.busy_ns;
+    thread_ns += other.thread_ns;
+}
+
+void PropagationStats::add(const PropagationStats& other) {
+    if (up.size() < other.up.size()) up.resize(other.up.size());
+    if (down.size() < other.down.size()) down.resize(other.down.size());
+    for (std::size_t r = 0; r < other.up.size(); ++r) up[r].add(other.up[r]);
+    for (std::size_t r = 0; r < other.down.size(); ++r) down[r].add(other.down[r]);
+    peer_receive.add(other.peer_receive);
+    peer_process.add(other.peer_process);
+    counters.add(other.counters);
+}
+
+static uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Pull-based receive: the receiving AS reads the RIBs of the given neighbors and
+// queues their routes (next hop = neighbor, relationship = rel_type). Only the
+// receiver's own queue is written, so receivers can run on different threads
+// as long as the neighbors' RIBs are not modified concurrently. kPolicy is the
+// receiver's policy class: customer-only skips whole links, peer lock and ASPA
+// mark the routes their path checks reject, ROV is applied while merging, and
+// plain ASes run the bare merge. kCount adds the receive outcomes to the
+// receiver's slot of counters (indexed like states).
+template <uint8_t kPolicy, bool kCount>
+static void receive_announcements(const ASGraph& graph, std::vector<BGPState>& states, uint32_t to_idx,
+                                  std::span<const uint32_t> sources, Rel rel_type, RouteCounters* counters,
+                                  const PolicyContext* policies) {
+    constexpr bool kRov = (kPolicy & POLICY_ROV) != 0;
+    constexpr bool kPathChecks = (kPolicy & (POLICY_PEER_LOCK | POLICY_ASPA)) != 0;
+    BGPState& to_state = states[to_idx];
+    if constexpr ((kPolicy & POLICY_CUSTOMER_ONLY) != 0) {
+        if (rel_type != CUST) {
+            if constexpr (kCount) {
+                for (uint32_t from_idx : sources) {
+                    counters[to_idx].received += states[from_idx].num_routes;
+                    counters[to_idx].policy_dropped += states[from_idx].num_routes;
+                }
+            }
+            return;
+        }
+    }
+    for (uint32_t from_idx : sources) {
+        RouteCounters* c = kCount ? &counters[to_idx] : nullptr;
+        if (kPathChecks && policies) {
+            ScratchArray<uint64_t> reject(to_state.prefix_words);
+            mark_path_rejects(*policies, states, to_idx, from_idx, rel_type, kPolicy, reject.data());
+            bgp_receive_rib<kRov>(to_state, states[from_idx], graph.nodes[from_idx].asn, rel_type, reject.data(), c);
+        } else {
+            bgp_receive_rib<kRov>(to_state, states[from_idx], graph.nodes[from_idx].asn, rel_type, nullptr, c);
+        }
+    }
+}
+
+template <bool kCount>
+static void process_queue(std::vector<BGPState>& states, uint32_t idx, RouteCounters* counters) {
+    const uint32_t updates = bgp_process_queue(states[idx]);
+    if constexpr (kCount) counters[idx].rib_updates += updates;
+}
+
+// Estimated work for an AS pulling from the given neighbors: every route a
+// neighbor holds is one receive, every own route is one RIB comparison.
+static uint64_t receive_cost(const std::vector<BGPState>& states, uint32_t idx, std::span<const uint32_t> sources) {
+    uint64_t cost = 1 + sources.size() + states[idx].num_routes;
+    for (uint32_t src : sources) {
+        cost += states[src].num_routes;
+    }
+    return cost;
+}
+
+// The ASes of one policy class within a step
+struct PolicyGroup {
+    uint8_t policy;
+    std::vector<uint32_t> nodes;
+};
+
+// Splits nodes by policy class, keeping their order within each class.
+// Collapsed stubs are left out: they take no part in propagation.
+static std::vector<PolicyGroup> group_by_policy(const std::vector<uint32_t>& nodes,
+                                                const std::vector<BGPState>& states) {
+    std::array<uint32_t, kNumPolicyClasses> count{};
+    for (uint32_t idx : nodes) count[states[idx].policy] += states[idx].is_stub() ? 0 : 1;
+    std::array<uint32_t, kNumPolicyClasses> slot{};
+    std::vector<PolicyGroup> groups;
+    for (unsigned c = 0; c < kNumPolicyClasses; ++c) {
+        if (!count[c]) continue;
+        slot[c] = static_cast<uint32_t>(groups.size());
+        groups.push_back(PolicyGroup{static_cast<uint8_t>(c), {}});
+        groups.back().nodes.reserve(count[c]);
+    }
+    for (uint32_t idx : nodes) {
+        if (!states[idx].is_stub()) groups[slot[states[idx].policy]].nodes.push_back(idx);
+    }
+    return groups;
+}
+
+// Calls fn(std::integral_constant<uint8_t, policy>{}), so fn is compiled once
+// per policy class and the class is a constant inside it
+template <typename Func, uint8_t... kClasses>
+static void with_policy_class(uint8_t policy, Func&& fn, std::integer_sequence<uint8_t, kClasses...>) {
+    (void)((policy == kClasses && (fn(std::integral_constant<uint8_t, kClasses>{}), true)) || ...);
+}
+
+// Helper: parallel for over the ASes of a step on the shared pool, one loop
+// per policy class with fn(policy, idx) specialized for that class.
+// cost(idx) weights each AS so chunks carry similar amounts of work; it is
+// not evaluated when the pool has a single thread. kTimed times the step and
+// adds every AS's work to the busy time of step.
+template <bool kTimed, typename Cost, typename Func>
+static void parallel_for_groups(ThreadPool& pool,
+                                const std::vector<PolicyGroup>& groups,
+                                Cost&& cost,
+                                Func&& fn,
+                                StepStats* step) {
+    std::atomic<uint64_t> busy{0};
+    const uint64_t start = kTimed ? now_ns() : 0;
+    std::size_t ases = 0;
+    for (const PolicyGroup& group : groups) {
+        const std::vector<uint32_t>& nodes = group.nodes;
+        with_policy_class(group.policy, [&](auto policy) {
+            pool.parallel_for(nodes.size(),
+                              [&](std::size_t i) { return cost(nodes[i]); },
+                              [&](std::size_t i) {
+                                  if constexpr (kTimed) {
+                                      const uint64_t t0 = now_ns();
+                                      fn(policy, nodes[i]);
+                                      busy.fetch_add(now_ns() - t0, std::memory_order_relaxed);
+                                  } else {
+                                      fn(policy, nodes[i]);
+                                  }
+                              });
+        }, std::make_integer_sequence<uint8_t, kNumPolicyClasses>{});
+        ases += nodes.size();
+    }
+    if constexpr (kTimed) {
+        const uint64_t wall = now_ns() - start;
+        ++step->calls;
+        step->ases += ases;
+        step->wall_ns += wall;
+        step->busy_ns += busy.load(std::memory_order_relaxed);
+        step->thread_ns += wall * pool.size();
+    }
+}
+
+// ASes that take part in the steps of one phase. Only an AS with a neighbor
+// it pulls from that holds routes can receive anything; every other AS would
+// read empty RIBs and process an empty queue. The frontier starts from the
+// ASes that hold routes and grows as steps give routes to more of them, so a
+// phase costs in proportion to how far the routes spread, not to graph size.
+class Frontier {
+public:
+    Frontier(const ASGraph& graph, std::size_t num_ranks)
+        : graph(graph), by_rank(num_ranks), tag(graph.nodes.size(), 0), holds(graph.nodes.size(), 0) {}
+
+    // Starts a phase: the neighbors (via adj) of every AS holding routes
+    void start(const Adjacency& adj) {
+        ++phase;
+        for (auto& nodes : by_rank) nodes.clear();
+        for (uint32_t idx : active) add_neighbors(adj, idx);
+    }
+    // Adds the neighbors of idx (via adj) to the frontier of the phase
+    void add_neighbors(const Adjacency& adj, uint32_t idx) {
+        for (uint32_t n : adj[idx]) {
+            if (tag[n] == phase) continue;
+            tag[n] = phase;
+            by_rank[static_cast<std::size_t>(graph.nodes[n].rank)].push_back(n);
+        }
+    }
+    // Records that idx holds routes; true the first time
+    bool add_holder(uint32_t idx) {
+        if (holds[idx]) return false;
+        holds[idx] = 1;
+        active.push_back(idx);
+        return true;
+    }
+
+    // The frontier within rank r (whose ASes are rank_nodes) in index order,
+    // so neighboring rows are worked on together. A large frontier is taken
+    // from rank_nodes in order instead of sorting it.
+    const std::vector<uint32_t>& rank(std::size_t r, const std::vector<uint32_t>& rank_nodes) {
+        std::vector<uint32_t>& nodes = by_rank[r];
+        if (nodes.size() * kDenseShare > rank_nodes.size()) {
+            nodes.clear();
+            for (uint32_t idx : rank_nodes) {
+                if (tag[idx] == phase) nodes.push_back(idx);
+            }
+        } else {
+            std::sort(nodes.begin(), nodes.end());
+        }
+        return nodes;
+    }
+    // The whole frontier of a phase that is not run rank by rank
+    std::vector<uint32_t> all(const std::vector<std::vector<uint32_t>>& ranks) {
+        std::vector<uint32_t> nodes;
+        for (std::size_t r = 0; r < by_rank.size(); ++r) {
+            const std::vector<uint32_t>& in_rank = rank(r, ranks[r]);
+            nodes.insert(nodes.end(), in_rank.begin(), in_rank.end());
+        }
+        return nodes;
+    }
+    const std::vector<uint32_t>& holders() const { return active; }
+
+private:
+    static constexpr std::size_t kDenseShare = 8;  // frontier above 1/8 of a rank: filter the rank
+
+    const ASGraph& graph;
+    std::vector<std::vector<uint32_t>> by_rank;
+    std::vector<uint8_t> tag;       // phase that last added the AS
+    std::vector<char> holds;        // AS holds routes
+    std::vector<uint32_t> active;   // ASes holding routes, in order found
+    uint8_t phase = 0;
+};
+
+// The three phases; kStats selects the timed and counted variant, so a run
+// without stats executes exactly the uninstrumented loops
+template <bool kStats>
+static void run_phases(const ASGraph& graph,
+                       const std::vector<std::vector<uint32_t>>& ranks,
+                       std::vector<BGPState>& states,
+                       ThreadPool& pool,
+                       PropagationStats* stats,
+                       RouteCounters* counters,
+                       const PolicyContext* policies) {
+    // The seeded ASes hold the first routes
+    Frontier frontier(graph, ranks.size());
+    for (uint32_t idx = 0; idx < graph.nodes.size(); ++idx) {
+        if (states[idx].num_routes) frontier.add_holder(idx);
+    }
+    // After a step, the ASes that got their first routes extend the frontier
+    auto grow = [&](const std::vector<uint32_t>& nodes, const Adjacency* adj) {
+        for (uint32_t idx : nodes) {
+            if (states[idx].num_routes && frontier.add_holder(idx) && adj) frontier.add_neighbors(*adj, idx);
+        }
+    };
+
+    // Every step runs one kernel per policy class present, so plain ASes never
+    // test a policy and each policy's checks are resolved at compile time.
+    // Every AS pulls from neighbors whose RIBs are final for the current phase
+    // and writes only its own queue/RIB, so all steps run in parallel and the
+    // result does not depend on the thread count.
+
+    // Phase 1: UP (customers -> providers)
+    // Customers sit in lower ranks and are already final
+    frontier.start(graph.providers);
+    for (size_t r = 0; r < ranks.size(); ++r) {
+        const std::vector<uint32_t>& nodes = frontier.rank(r, ranks[r]);
+        parallel_for_groups<kStats>(pool, group_by_policy(nodes, states), [&](uint32_t idx) {
+            return receive_cost(states, idx, graph.customers[idx]);
+        }, [&](auto policy, uint32_t idx) {
+            receive_announcements<decltype(policy)::value, kStats>(graph, states, idx, graph.customers[idx], CUST, counters, policies);
+            process_queue<kStats>(states, idx, counters);
+        }, kStats ? &stats->up[r] : nullptr);
+        grow(nodes, &graph.providers);
+    }
+
+    // Phase 2: PEERS
+    // All ASes receive before any AS processes, so routes travel one hop only
+    frontier.start(graph.peers);
+    const std::vector<uint32_t> peer_nodes = frontier.all(ranks);
+    parallel_for_groups<kStats>(pool, group_by_policy(peer_nodes, states), [&](uint32_t idx) {
+        return receive_cost(states, idx, graph.peers[idx]);
+    }, [&](auto policy, uint32_t idx) {
+        receive_announcements<decltype(policy)::value, kStats>(graph, states, idx, graph.peers[idx], PEER, counters, policies);
+    }, kStats ? &stats->peer_receive : nullptr);
+    parallel_for_groups<kStats>(pool, {PolicyGroup{0, peer_nodes}}, [&](uint32_t idx) {
+        return 1 + graph.peers.degree(idx);
+    }, [&](auto, uint32_t idx) {
+        process_queue<kStats>(states, idx, counters);
+    }, kStats ? &stats->peer_process : nullptr);
+    grow(peer_nodes, nullptr);
+
+    // Phase 3: DOWN (providers -> customers)
+    // Providers sit in higher ranks and are already final
+    frontier.start(graph.customers);
+    for (int r = static_cast<int>(ranks.size()) - 1; r >= 0; --r) {
+        const std::vector<uint32_t>& nodes = frontier.rank(static_cast<size_t>(r), ranks[static_cast<size_t>(r)]);
+        parallel_for_groups<kStats>(pool, group_by_policy(nodes, states), [&](uint32_t idx) {
+            return receive_cost(states, idx, graph.providers[idx]);
+        }, [&](auto policy, uint32_t idx) {
+            receive_announcements<decltype(policy)::value, kStats>(graph, states, idx, graph.providers[idx], PROV, counters, policies);
+            process_queue<kStats>(states, idx, counters);
+        }, kStats ? &stats->down[static_cast<size_t>(r)] : nullptr);
+        grow(nodes, &graph.customers);
+    }
+}
+
+// A collapsed stub holds exactly its provider's routes
+static void count_stub_routes(std::vector<BGPState>& states) {
+    for (BGPState& st : states) {
+        if (st.is_stub()) st.num_routes = states[st.stub_provider].num_routes;
+    }
+}
+
+void propagate(const ASGraph& graph,
+               const std::vector<std::vector<uint32_t>>& ranks,
+               std::vector<BGPState>& states,
+               ThreadPool& pool,
+               PropagationStats* stats,
+               const PolicyContext* policies) {
+    if (!stats) {
+        run_phases<false>(graph, ranks, states, pool, nullptr, nullptr, policies);
+        count_stub_routes(states);
+        return;
+    }
+    if (stats->up.size() < ranks.size()) stats->up.resize(ranks.size());
+    if (stats->down.size() < ranks.size()) stats->down.resize(ranks.size());
+    // Each AS counts into its own slot, so counting needs no synchronization
+    std::vector<RouteCounters> counters(states.size());
+    run_phases<true>(graph, ranks, states, pool, stats, counters.data(), policies);
+    for (const RouteCounters& c : counters) stats->counters.add(c);
+    count_stub_routes(states);
+}
+
+std::size_t collapse_stubs(const ASGraph& graph, const std::vector<char>& originates, std::vector<BGPState>& states) {
+    std::size_t collapsed = 0;
+    for (uint32_t idx = 0; idx < graph.nodes.size(); ++idx) {
+        BGPState& st = states[idx];
+        if (graph.providers.degree(idx) != 1 || graph.customers.degree(idx) != 0 || graph.peers.degree(idx) != 0 ||
+            originates[idx] || st.policy != 0) {
+            continue;
+        }
+        st.stub_provider = graph.providers[idx][0];
+        st.stub_provider_asn = graph.nodes[st.stub_provider].asn;
+        ++collapsed;
+    }
+    return collapsed;
+}
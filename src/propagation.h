@@ -0,0 +1,57 @@
+// Propagation - three-phase route propagation (up / peers / down) over the ranked AS graph
+// Works on a caller-provided state vector so independent prefix batches can run side by side
+#pragma once
+
+#include "as_graph.h"
+#include "bgp.h"
+#include "policy.h"
+#include "thread_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Timing of one parallel step (an up/down rank or a peer sub-phase), summed
+// over calls. busy_ns adds up the time threads spent inside per-AS work and
+// thread_ns is wall_ns times the pool size, so busy_ns / thread_ns is the
+// pool utilization of the step.
+struct StepStats {
+    uint64_t calls = 0;
+    uint64_t ases = 0;
+    uint64_t wall_ns = 0;
+    uint64_t busy_ns = 0;
+    uint64_t thread_ns = 0;
+
+    void add(const StepStats& other);
+};
+
+// Optional instrumentation of propagate(); see --stats
+struct PropagationStats {
+    std::vector<StepStats> up;    // indexed by rank
+    StepStats peer_receive;
+    StepStats peer_process;
+    std::vector<StepStats> down;  // indexed by rank
+    RouteCounters counters;
+
+    void add(const PropagationStats& other);
+};
+
+// Runs the up, peer and down phases for every prefix held in states
+// (one BGPState per graph node, indexed like graph.nodes). ranks must come
+// from ASGraph::rank_topology. Output is identical for any pool size.
+// Timings and counters are added to stats if it is not null; without it no
+// clock is read. Every AS is filtered by its BGPState::policy; policies must
+// be given if any AS uses peer lock or ASPA.
+void propagate(const ASGraph& graph,
+               const std::vector<std::vector<uint32_t>>& ranks,
+               std::vector<BGPState>& states,
+               ThreadPool& pool,
+               PropagationStats* stats = nullptr,
+               const PolicyContext* policies = nullptr);
+
+// Collapses the pure single-homed stubs into their providers: ASes with one
+// provider, no customers and no peers that originate nothing (originates is
+// indexed like graph.nodes) and run no policy. Their routes are always the
+// provider's, one hop longer, so they get no RIB rows and propagation skips
+// them; for_each_route derives their routes when results are read. Must run
+// before the states are bound to a BGPTable. Returns the number of stubs.
+std::size_t collapse_stubs(const ASGraph& graph, const std::vector<char>& originates, std::vector<BGPState>& states);
@@ -0,0 +1,343 @@
+#include "result_store.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <numeric>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File layout (every section padded to 8 bytes):
+//   header
+//   segments, each: SegmentHeader, route_offsets[num_nodes + 1] (u64),
+//                   route_prefix[num_routes] (u32), path_offsets[num_routes + 1] (u64),
+//                   path_asns[num_path_asns] (u32)
+//   node_asn[num_nodes] (u32, ascending)
+//   prefix_offsets[num_prefixes + 1] (u64), prefix_order[num_prefixes] (u32), prefix_chars
+//   segment_offsets[num_segments] (u64, file offsets of the segment headers)
+//   anns[num_anns] (AnnRow), rov_asns[num_rov] (u32, ascending)
+struct StoreHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_nodes;
+    uint32_t num_prefixes;
+    uint32_t num_segments;
+    uint64_t num_routes;
+    uint64_t prefix_chars;
+    uint64_t tables_offset;  // file offset of node_asn
+    uint64_t source_hash;    // hash of the CAIDA file the run used
+    uint64_t num_anns;
+    uint64_t num_rov;
+};
+
+struct SegmentHeader {
+    uint32_t prefix_begin;
+    uint32_t prefix_end;
+    uint64_t num_routes;
+    uint64_t num_path_asns;
+};
+
+static constexpr char kMagic[8] = {'B', 'G', 'P', 'R', 'I', 'B', 'S', '1'};
+
+static inline uint64_t padded_bytes(uint64_t bytes) { return (bytes + 7) & ~uint64_t{7}; }
+
+// Whether offsets[0..count] rise monotonically from 0 to total
+static bool valid_offsets(const uint64_t* offsets, uint64_t count, uint64_t total) {
+    if (offsets[0] != 0 || offsets[count] != total) return false;
+    for (uint64_t i = 0; i < count; ++i) {
+        if (offsets[i] > offsets[i + 1]) return false;
+    }
+    return true;
+}
+
+// Nodes per build chunk; chunks are built in parallel and concatenated
+static constexpr std::size_t kNodesPerChunk = 2048;
+
+void build_store_segment(StoreSegment& seg, const AsnLookup& lookup, const std::vector<BGPState>& states,
+                         std::span<const uint32_t> nodes, PrefixID prefix_base, std::size_t num_prefixes,
+                         ThreadPool& pool) {
+    seg.prefix_begin = prefix_base;
+    seg.prefix_end = static_cast<PrefixID>(prefix_base + num_prefixes);
+
+    struct Chunk {
+        std::vector<uint32_t> route_count;  // per node
+        std::vector<uint32_t> route_prefix;
+        std::vector<uint32_t> path_len;     // per route
+        std::vector<uint32_t> path_asns;
+    };
+    const std::size_t num_chunks = (nodes.size() + kNodesPerChunk - 1) / kNodesPerChunk;
+    std::vector<Chunk> chunks(num_chunks);
+    pool.parallel_for(num_chunks, [&](std::size_t c) {
+        uint64_t cost = 1;
+        const std::size_t end = std::min(nodes.size(), (c + 1) * kNodesPerChunk);
+        for (std::size_t k = c * kNodesPerChunk; k < end; ++k) cost += states[nodes[k]].num_routes;
+        return cost;
+    }, [&](std::size_t c) {
+        Chunk& chunk = chunks[c];
+        const std::size_t end = std::min(nodes.size(), (c + 1) * kNodesPerChunk);
+        for (std::size_t k = c * kNodesPerChunk; k < end; ++k) {
+            chunk.route_count.push_back(states[nodes[k]].num_routes);
+            for_each_route(states, nodes[k], [&](PrefixID prefix_id, const Announcement& ann) {
+                chunk.route_prefix.push_back(prefix_base + prefix_id);
+                const std::size_t before = chunk.path_asns.size();
+                for_each_path_hop(lookup, states, prefix_id, ann, [&](ASN hop) {
+                    chunk.path_asns.push_back(hop);
+                });
+                chunk.path_len.push_back(static_cast<uint32_t>(chunk.path_asns.size() - before));
+            });
+        }
+    });
+
+    seg.route_offsets.assign(1, 0);
+    seg.route_offsets.reserve(nodes.size() + 1);
+    seg.route_prefix.clear();
+    seg.path_offsets.assign(1, 0);
+    seg.path_asns.clear();
+    for (Chunk& chunk : chunks) {
+        for (uint32_t count : chunk.route_count) seg.route_offsets.push_back(seg.route_offsets.back() + count);
+        seg.route_prefix.insert(seg.route_prefix.end(), chunk.route_prefix.begin(), chunk.route_prefix.end());
+        for (uint32_t len : chunk.path_len) seg.path_offsets.push_back(seg.path_offsets.back() + len);
+        seg.path_asns.insert(seg.path_asns.end(), chunk.path_asns.begin(), chunk.path_asns.end());
+        chunk = Chunk();
+    }
+}
+
+ResultStoreWriter::~ResultStoreWriter() {
+    if (fp) {
+        fclose(fp);
+        std::remove(tmp_path.c_str());
+    }
+}
+
+bool ResultStoreWriter::open(const std::string& store_path, std::vector<ASN> asns) {
+    path = store_path;
+    // Unique per process and per store written by it: concurrent runs (and
+    // --batch jobs) writing the same store must not share a temporary file
+    static std::atomic<uint64_t> next_tmp{0};
+    tmp_path = store_path + "." + std::to_string(::getpid()) + "." + std::to_string(next_tmp++) + ".tmp";
+    fp = fopen(tmp_path.c_str(), "wb");
+    if (!fp) {
+        std::cerr << "Failed to create result store " << tmp_path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    node_asns = std::move(asns);
+    // The header is rewritten with the final counts in finish()
+    StoreHeader hdr{};
+    write(&hdr, sizeof(hdr));
+    return !failed;
+}
+
+void ResultStoreWriter::write(const void* data, std::size_t bytes) {
+    static constexpr char kZeros[8] = {};
+    if (failed) return;
+    const uint64_t pad = padded_bytes(bytes) - bytes;
+    if (fwrite(data, 1, bytes, fp) != bytes || fwrite(kZeros, 1, pad, fp) != pad) failed = true;
+    offset += bytes + pad;
+}
+
+void ResultStoreWriter::append(const StoreSegment& seg) {
+    SegmentHeader sh{seg.prefix_begin, seg.prefix_end, seg.route_prefix.size(), seg.path_asns.size()};
+    segment_offsets.push_back(offset);
+    num_routes += seg.route_prefix.size();
+    write(&sh, sizeof(sh));
+    write(seg.route_offsets.data(), seg.route_offsets.size() * sizeof(uint64_t));
+    write(seg.route_prefix.data(), seg.route_prefix.size() * sizeof(uint32_t));
+    write(seg.path_offsets.data(), seg.path_offsets.size() * sizeof(uint64_t));
+    write(seg.path_asns.data(), seg.path_asns.size() * sizeof(uint32_t));
+}
+
+bool ResultStoreWriter::finish(const std::vector<std::string>& prefixes, uint64_t source_hash,
+                               const std::vector<AnnRow>& anns, const std::vector<ASN>& rov_asns) {
+    StoreHeader hdr{};
+    std::memcpy(hdr.magic, kMagic, sizeof(kMagic));
+    hdr.version = kResultStoreVersion;
+    hdr.num_nodes = static_cast<uint32_t>(node_asns.size());
+    hdr.num_prefixes = static_cast<uint32_t>(prefixes.size());
+    hdr.num_segments = static_cast<uint32_t>(segment_offsets.size());
+    hdr.num_routes = num_routes;
+    hdr.tables_offset = offset;
+    hdr.source_hash = source_hash;
+    hdr.num_anns = anns.size();
+    hdr.num_rov = rov_asns.size();
+
+    write(node_asns.data(), node_asns.size() * sizeof(uint32_t));
+
+    std::vector<uint64_t> prefix_offsets(prefixes.size() + 1, 0);
+    for (std::size_t i = 0; i < prefixes.size(); ++i) {
+        prefix_offsets[i + 1] = prefix_offsets[i] + prefixes[i].size();
+    }
+    std::vector<uint32_t> prefix_order(prefixes.size());
+    std::iota(prefix_order.begin(), prefix_order.end(), 0u);
+    std::sort(prefix_order.begin(), prefix_order.end(), [&](uint32_t a, uint32_t b) {
+        return prefixes[a] < prefixes[b];
+    });
+    std::string chars;
+    chars.reserve(prefix_offsets.back());
+    for (const std::string& p : prefixes) chars += p;
+    hdr.prefix_chars = chars.size();
+    write(prefix_offsets.data(), prefix_offsets.size() * sizeof(uint64_t));
+    write(prefix_order.data(), prefix_order.size() * sizeof(uint32_t));
+    write(chars.data(), chars.size());
+    write(segment_offsets.data(), segment_offsets.size() * sizeof(uint64_t));
+    write(anns.data(), anns.size() * sizeof(AnnRow));
+    write(rov_asns.data(), rov_asns.size() * sizeof(ASN));
+
+    if (!failed && (fseek(fp, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, fp) != 1)) failed = true;
+    const bool closed = fclose(fp) == 0;
+    fp = nullptr;
+    if (failed || !closed || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error writing result store " << path << "\n";
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ResultStore::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open result store " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(StoreHeader)) {
+        ::close(fd);
+        std::cerr << "Not a result store: " << path << "\n";
+        return false;
+    }
+    const std::size_t file_size = static_cast<std::size_t>(st.st_size);
+    void* map = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        std::cerr << "Failed to map result store " << path << "\n";
+        return false;
+    }
+    mapping = std::shared_ptr<const void>(map, [file_size](const void* p) {
+        munmap(const_cast<void*>(p), file_size);
+    });
+
+    const char* base = static_cast<const char*>(map);
+    const auto* hdr = static_cast<const StoreHeader*>(map);
+    if (std::memcmp(hdr->magic, kMagic, sizeof(kMagic)) != 0 || hdr->version != kResultStoreVersion) {
+        std::cerr << "Not a result store (or another format version): " << path << "\n";
+        mapping.reset();
+        return false;
+    }
+
+    // Hands out the section at pos, or nullptr if it would run past the end of the file
+    uint64_t pos = 0;
+    bool ok = true;
+    auto take = [&](uint64_t bytes) -> const char* {
+        if (!ok || pos > file_size || padded_bytes(bytes) > file_size - pos) {
+            ok = false;
+            return nullptr;
+        }
+        const char* section = base + pos;
+        pos += padded_bytes(bytes);
+        return section;
+    };
+
+    n_nodes = hdr->num_nodes;
+    n_prefixes = hdr->num_prefixes;
+    n_routes = hdr->num_routes;
+    pos = hdr->tables_offset;
+    node_asns = reinterpret_cast<const uint32_t*>(take(uint64_t{n_nodes} * 4));
+    prefix_offsets = reinterpret_cast<const uint64_t*>(take((uint64_t{n_prefixes} + 1) * 8));
+    prefix_order = reinterpret_cast<const uint32_t*>(take(uint64_t{n_prefixes} * 4));
+    prefix_chars = take(hdr->prefix_chars);
+    const auto* segment_offsets = reinterpret_cast<const uint64_t*>(take(uint64_t{hdr->num_segments} * 8));
+    const auto* anns = reinterpret_cast<const AnnRow*>(take(hdr->num_anns * sizeof(AnnRow)));
+    const auto* rov_list = reinterpret_cast<const ASN*>(take(hdr->num_rov * sizeof(ASN)));
+    if (ok && !valid_offsets(prefix_offsets, n_prefixes, hdr->prefix_chars)) ok = false;
+    for (uint64_t i = 0; ok && i < hdr->num_anns; ++i) {
+        if (anns[i].prefix_id >= n_prefixes) ok = false;
+    }
+    if (ok) {
+        src_hash = hdr->source_hash;
+        ann_rows = {anns, hdr->num_anns};
+        rov = {rov_list, hdr->num_rov};
+    }
+
+    segments.clear();
+    uint64_t total_routes = 0;
+    for (uint32_t s = 0; ok && s < hdr->num_segments; ++s) {
+        pos = segment_offsets[s];
+        const auto* sh = reinterpret_cast<const SegmentHeader*>(take(sizeof(SegmentHeader)));
+        if (!sh) break;
+        // Counts beyond the file size could only be corrupt, and would overflow the section sizes below
+        if (sh->num_routes > file_size / 8 || sh->num_path_asns > file_size / 4) {
+            ok = false;
+            break;
+        }
+        Segment seg;
+        seg.prefix_begin = sh->prefix_begin;
+        seg.prefix_end = sh->prefix_end;
+        seg.route_base = total_routes;
+        seg.route_offsets = reinterpret_cast<const uint64_t*>(take((uint64_t{n_nodes} + 1) * 8));
+        seg.route_prefix = reinterpret_cast<const uint32_t*>(take(sh->num_routes * 4));
+        seg.path_offsets = reinterpret_cast<const uint64_t*>(take((sh->num_routes + 1) * 8));
+        seg.path_asns = reinterpret_cast<const uint32_t*>(take(sh->num_path_asns * 4));
+        // Every offset is used to index the columns and every route prefix to
+        // find a prefix, so all are checked before the first query
+        if (!ok || seg.prefix_begin > seg.prefix_end || seg.prefix_end > n_prefixes ||
+            !valid_offsets(seg.route_offsets, n_nodes, sh->num_routes) ||
+            !valid_offsets(seg.path_offsets, sh->num_routes, sh->num_path_asns) ||
+            !std::all_of(seg.route_prefix, seg.route_prefix + sh->num_routes,
+                         [&](uint32_t id) { return id >= seg.prefix_begin && id < seg.prefix_end; })) {
+            ok = false;
+            break;
+        }
+        total_routes += sh->num_routes;
+        segments.push_back(seg);
+    }
+    if (!ok || total_routes != n_routes) {
+        std::cerr << "Truncated or inconsistent result store: " << path << "\n";
+        segments.clear();
+        mapping.reset();
+        return false;
+    }
+    return true;
+}
+
+uint32_t ResultStore::find_node(ASN asn) const {
+    const uint32_t* it = std::lower_bound(node_asns, node_asns + n_nodes, asn);
+    return (it != node_asns + n_nodes && *it == asn) ? static_cast<uint32_t>(it - node_asns) : kNotFound;
+}
+
+uint32_t ResultStore::find_prefix(std::string_view text) const {
+    const uint32_t* it = std::lower_bound(prefix_order, prefix_order + n_prefixes, text,
+                                          [&](uint32_t id, std::string_view t) { return prefix(id) < t; });
+    return (it != prefix_order + n_prefixes && prefix(*it) == text) ? *it : kNotFound;
+}
+
+const ResultStore::Segment* ResultStore::find_segment(PrefixID prefix_id) const {
+    // Segments cover disjoint prefix ranges in ascending order
+    auto seg_it = std::upper_bound(segments.begin(), segments.end(), prefix_id,
+                                   [](PrefixID id, const Segment& s) { return id < s.prefix_end; });
+    if (seg_it == segments.end() || prefix_id < seg_it->prefix_begin) return nullptr;
+    return &*seg_it;
+}
+
+uint64_t ResultStore::find_in_segment(const Segment& seg, uint32_t node, PrefixID prefix_id) {
+    const uint32_t* first = seg.route_prefix + seg.route_offsets[node];
+    const uint32_t* last = seg.route_prefix + seg.route_offsets[node + 1];
+    const uint32_t* it = std::lower_bound(first, last, prefix_id);
+    return (it == last || *it != prefix_id) ? kNoRoute : static_cast<uint64_t>(it - seg.route_prefix);
+}
+
+bool ResultStore::route(uint32_t node, PrefixID prefix_id, std::span<const uint32_t>& path) const {
+    const Segment* seg = find_segment(prefix_id);
+    const uint64_t r = seg ? find_in_segment(*seg, node, prefix_id) : kNoRoute;
+    if (r == kNoRoute) return false;
+    path = path_of(*seg, r);
+    return true;
+}
+
+uint64_t ResultStore::find_route(uint32_t node, PrefixID prefix_id) const {
+    const Segment* seg = find_segment(prefix_id);
+    const uint64_t r = seg ? find_in_segment(*seg, node, prefix_id) : kNoRoute;
+    return r == kNoRoute ? kNoRoute : seg->route_base + r;
+}
@@ -0,0 +1,160 @@
+// Result store - binary columnar image of the simulated RIBs, used in place via mmap
+// Holds the prefix table, the ASN-sorted node table and one segment of routes and AS paths per batch
+#pragma once
+
+#include "bgp.h"
+#include "rib_writer.h"
+#include "thread_pool.h"
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Bump whenever the on-disk layout or the meaning of a section changes
+constexpr uint32_t kResultStoreVersion = 2;
+
+// One announcement row as simulated, in input order (the last row of an AS for
+// a prefix wins); stored so a later run can tell which prefixes changed
+struct AnnRow {
+    ASN asn;
+    PrefixID prefix_id;
+    uint32_t rov_invalid;
+};
+
+// Routes of one prefix batch in columnar form. Store node k is the k-th entry
+// of the node table (ascending ASN); paths leave out the AS itself.
+struct StoreSegment {
+    PrefixID prefix_begin = 0;            // global PrefixIDs [prefix_begin, prefix_end)
+    PrefixID prefix_end = 0;
+    std::vector<uint64_t> route_offsets;  // routes of node k: [route_offsets[k], route_offsets[k + 1])
+    std::vector<uint32_t> route_prefix;   // global PrefixID per route, ascending per node
+    std::vector<uint64_t> path_offsets;   // hops of route r: path_asns[path_offsets[r] .. path_offsets[r + 1])
+    std::vector<uint32_t> path_asns;      // next hop first, origin last
+};
+
+// Fills seg from a propagated batch (prefix IDs in states are local to the
+// batch, offset by prefix_base). nodes lists the graph indices of the store
+// nodes in store order. Node ranges are built on the pool.
+void build_store_segment(StoreSegment& seg, const AsnLookup& lookup, const std::vector<BGPState>& states,
+                         std::span<const uint32_t> nodes, PrefixID prefix_base, std::size_t num_prefixes,
+                         ThreadPool& pool);
+
+// Writes a store: segments are appended as batches finish, the node and prefix
+// tables and the segment directory follow in finish(). The file appears under
+// its final name only once finish() succeeded.
+class ResultStoreWriter {
+public:
+    ResultStoreWriter() = default;
+    ~ResultStoreWriter();
+    ResultStoreWriter(const ResultStoreWriter&) = delete;
+    ResultStoreWriter& operator=(const ResultStoreWriter&) = delete;
+
+    // node_asns must be sorted ascending; false (with a message) if path cannot be created
+    bool open(const std::string& path, std::vector<ASN> node_asns);
+    void append(const StoreSegment& seg);
+    // Adds the tables and the run's inputs (hash of the CAIDA file, announcement
+    // rows, ROV ASNs sorted ascending) and moves the file into place
+    bool finish(const std::vector<std::string>& prefixes, uint64_t source_hash,
+                const std::vector<AnnRow>& anns, const std::vector<ASN>& rov_asns);
+
+private:
+    void write(const void* data, std::size_t bytes);
+
+    std::string path;
+    std::string tmp_path;
+    FILE* fp = nullptr;
+    uint64_t offset = 0;
+    uint64_t num_routes = 0;
+    bool failed = false;
+    std::vector<ASN> node_asns;
+    std::vector<uint64_t> segment_offsets;
+};
+
+// Read-only view of a store. Nothing is copied: lookups binary-search the
+// mapped node, prefix and route columns.
+class ResultStore {
+public:
+    static constexpr uint32_t kNotFound = UINT32_MAX;
+    static constexpr uint64_t kNoRoute = UINT64_MAX;
+
+    // Maps path; false (with a message) if it is missing, truncated, from another
+    // version, or has offsets that are not monotonic or route prefixes out of range
+    bool open(const std::string& path);
+
+    uint32_t num_nodes() const { return n_nodes; }
+    uint32_t num_prefixes() const { return n_prefixes; }
+    uint32_t num_segments() const { return static_cast<uint32_t>(segments.size()); }
+    uint64_t num_routes() const { return n_routes; }
+    uint64_t source_hash() const { return src_hash; }
+    std::span<const AnnRow> anns() const { return ann_rows; }
+    std::span<const ASN> rov_asns() const { return rov; }
+
+    ASN node_asn(uint32_t node) const { return node_asns[node]; }
+    std::string_view prefix(PrefixID prefix_id) const {
+        return {prefix_chars + prefix_offsets[prefix_id], prefix_offsets[prefix_id + 1] - prefix_offsets[prefix_id]};
+    }
+    uint32_t find_node(ASN asn) const;
+    uint32_t find_prefix(std::string_view prefix) const;
+
+    // AS path of node towards prefix_id (hops after the AS itself); false if it has no route
+    bool route(uint32_t node, PrefixID prefix_id, std::span<const uint32_t>& path) const;
+    // Index of node's route to prefix_id among all routes of the store, in
+    // the order for_each_route visits them; kNoRoute if it has none
+    uint64_t find_route(uint32_t node, PrefixID prefix_id) const;
+
+    // Calls fn(node, prefix_id, path) for every route of node, in prefix order
+    template <typename Func>
+    void for_each_route_of(uint32_t node, Func&& fn) const {
+        for (const Segment& seg : segments) {
+            for (uint64_t r = seg.route_offsets[node]; r < seg.route_offsets[node + 1]; ++r) {
+                fn(node, seg.route_prefix[r], path_of(seg, r));
+            }
+        }
+    }
+
+    // Calls fn(node, prefix_id, path) for every route in the store, by route index
+    template <typename Func>
+    void for_each_route(Func&& fn) const {
+        for (const Segment& seg : segments) {
+            for (uint32_t node = 0; node < n_nodes; ++node) {
+                for (uint64_t r = seg.route_offsets[node]; r < seg.route_offsets[node + 1]; ++r) {
+                    fn(node, seg.route_prefix[r], path_of(seg, r));
+                }
+            }
+        }
+    }
+
+private:
+    struct Segment {
+        PrefixID prefix_begin;
+        PrefixID prefix_end;
+        uint64_t route_base;  // routes of the segments before this one
+        const uint64_t* route_offsets;
+        const uint32_t* route_prefix;
+        const uint64_t* path_offsets;
+        const uint32_t* path_asns;
+    };
+
+    const Segment* find_segment(PrefixID prefix_id) const;
+    // Position of node's route to prefix_id within seg, kNoRoute if it has none
+    static uint64_t find_in_segment(const Segment& seg, uint32_t node, PrefixID prefix_id);
+    static std::span<const uint32_t> path_of(const Segment& seg, uint64_t r) {
+        return {seg.path_asns + seg.path_offsets[r], seg.path_asns + seg.path_offsets[r + 1]};
+    }
+
+    std::shared_ptr<const void> mapping;
+    uint64_t src_hash = 0;
+    std::span<const AnnRow> ann_rows;
+    std::span<const ASN> rov;
+    uint32_t n_nodes = 0;
+    uint32_t n_prefixes = 0;
+    uint64_t n_routes = 0;
+    const uint32_t* node_asns = nullptr;
+    const uint64_t* prefix_offsets = nullptr;
+    const uint32_t* prefix_order = nullptr;  // prefix IDs sorted by prefix text
+    const char* prefix_chars = nullptr;
+    std::vector<Segment> segments;
+};
@@ -0,0 +1,128 @@
+#include "rib_writer.h"
+#include "mempool.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+// Rows per formatting chunk (roughly 1-2 MiB of text); a round formats a few
+// chunks per thread before they are written out
+static constexpr uint64_t kRowsPerChunk = 32768;
+static constexpr std::size_t kChunksPerRound = 2;
+
+OutputSink::~OutputSink() {
+    if (owned) ::close(fd);
+}
+
+bool OutputSink::open(const std::string& path) {
+    int new_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (new_fd < 0) {
+        std::cerr << "Failed to open output file " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    if (owned) ::close(fd);
+    fd = new_fd;
+    owned = true;
+    return true;
+}
+
+void OutputSink::write(std::string_view data) {
+    while (!failed && !data.empty()) {
+        ssize_t n = ::write(fd, data.data(), data.size());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error writing output: " << std::strerror(errno) << "\n";
+            failed = true;
+            return;
+        }
+        data.remove_prefix(static_cast<std::size_t>(n));
+    }
+}
+
+AsnLookup::AsnLookup(const ASGraph& graph) {
+    // At most half full
+    std::size_t capacity = 16;
+    while (capacity < graph.nodes.size() * 2) capacity <<= 1;
+    slots.assign(capacity, kEmpty);
+    mask = capacity - 1;
+    for (uint32_t idx = 0; idx < graph.nodes.size(); ++idx) {
+        const ASN asn = graph.nodes[idx].asn;
+        uint64_t h = slot_of(asn);
+        while (slots[h] != kEmpty) h = (h + 1) & mask;
+        slots[h] = (uint64_t{asn} << 32) | idx;
+    }
+}
+
+static inline void append_asn(std::string& out, ASN asn) {
+    char buf[10];
+    auto res = std::to_chars(buf, buf + sizeof(buf), asn);
+    out.append(buf, res.ptr);
+}
+
+void format_rib_rows(std::string& out, const ASGraph& graph, const AsnLookup& lookup,
+                     const std::vector<BGPState>& states, std::span<const uint32_t> nodes,
+                     const std::vector<std::string>& prefixes, PrefixID prefix_base, const LaneSlots& lanes) {
+    for (uint32_t idx : nodes) {
+        const ASN asn = graph.nodes[idx].asn;
+        for_each_route(states, idx, [&](PrefixID prefix_id, const Announcement& ann) {
+            append_asn(out, asn);
+            out.push_back(',');
+            out.append(prefixes[prefix_base + lanes.prefix(prefix_id)]);
+            out.push_back(',');
+            append_asn(out, asn);
+            for_each_path_hop(lookup, states, prefix_id, ann, [&](ASN hop) {
+                out.push_back('-');
+                append_asn(out, hop);
+            });
+            out.push_back('\n');
+        }, lanes.mask);
+    }
+}
+
+void write_ribs(std::span<OutputSink> sinks, const ASGraph& graph, const AsnLookup& lookup,
+                const std::vector<BGPState>& states, std::span<const uint32_t> nodes,
+                const std::vector<std::string>& prefixes, PrefixID prefix_base, ThreadPool& pool,
+                std::span<const LaneSlots> lanes) {
+    // Node ranges holding about kRowsPerChunk rows each (bounds are positions in nodes)
+    const std::size_t n = nodes.size();
+    ScratchArray<std::size_t> bounds(n + 1);
+    ScratchArray<uint64_t> rows(n);
+    std::size_t num_chunks = 0;
+    bounds[0] = 0;
+    uint64_t acc = 0;
+    for (std::size_t k = 0; k < n; ++k) {
+        acc += states[nodes[k]].num_routes;
+        if (acc >= kRowsPerChunk) {
+            rows[num_chunks] = acc;
+            bounds[++num_chunks] = k + 1;
+            acc = 0;
+        }
+    }
+    if (bounds[num_chunks] != n) {
+        rows[num_chunks] = acc;
+        bounds[++num_chunks] = n;
+    }
+
+    // Every lane of a chunk is formatted by the same task, one after another:
+    // the lanes of a prefix share cache lines along the path walks
+    const std::size_t num_lanes = lanes.size();
+    const std::size_t round = std::max<std::size_t>(1, std::size_t{pool.size()} * kChunksPerRound);
+    std::vector<std::string> buffers(std::min(round, num_chunks) * num_lanes);
+    for (std::size_t first = 0; first < num_chunks; first += round) {
+        const std::size_t count = std::min(round, num_chunks - first);
+        pool.parallel_for(count, [&](std::size_t i) { return 1 + rows[first + i]; }, [&](std::size_t i) {
+            const auto chunk = nodes.subspan(bounds[first + i], bounds[first + i + 1] - bounds[first + i]);
+            for (std::size_t l = 0; l < num_lanes; ++l) {
+                std::string& buf = buffers[i * num_lanes + l];
+                buf.clear();
+                format_rib_rows(buf, graph, lookup, states, chunk, prefixes, prefix_base, lanes[l]);
+            }
+        });
+        for (std::size_t i = 0; i < count; ++i) {
+            for (std::size_t l = 0; l < num_lanes; ++l) sinks[l].write(buffers[i * num_lanes + l]);
+        }
+    }
+}
@@ -0,0 +1,97 @@
+// RIB writer - formats "asn,prefix,as_path" rows and writes them with large write(2) calls
+// Rows are formatted in parallel over node ranges and written in node order
+#pragma once
+
+#include "as_graph.h"
+#include "bgp.h"
+#include "thread_pool.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Unbuffered output file (stdout by default); every write goes straight to the descriptor
+class OutputSink {
+public:
+    OutputSink() = default;
+    ~OutputSink();
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    // Creates or truncates path; false (with a message) if it cannot be opened
+    bool open(const std::string& path);
+    // Writes all of data, retrying partial writes; remembers the first failure
+    void write(std::string_view data);
+    bool ok() const { return !failed; }
+
+private:
+    int fd = 1;
+    bool owned = false;
+    bool failed = false;
+};
+
+// ASN -> node index table for the path walk: open addressing over one flat
+// array, so a lookup is a single probe in most cases (asn_to_index allocates
+// a node per entry and costs a few dependent cache misses)
+class AsnLookup {
+public:
+    static constexpr uint32_t kNotFound = UINT32_MAX;
+
+    explicit AsnLookup(const ASGraph& graph);
+    uint32_t find(ASN asn) const {
+        for (uint64_t h = slot_of(asn);; h = (h + 1) & mask) {
+            const uint64_t entry = slots[h];
+            if (entry == kEmpty) return kNotFound;
+            if ((entry >> 32) == asn) return static_cast<uint32_t>(entry);
+        }
+    }
+
+private:
+    static constexpr uint64_t kEmpty = UINT64_MAX;
+    uint64_t slot_of(ASN asn) const { return (uint64_t{asn} * 0x9E3779B97F4A7C15ull >> 32) & mask; }
+
+    std::vector<uint64_t> slots;  // (asn << 32) | index, kEmpty if unused
+    uint64_t mask = 0;
+};
+
+// Calls fn(asn) for every hop of the AS path behind ann after the AS itself,
+// next hop first and origin last. The path is rebuilt by following next hops:
+// RIB entries are never replaced by worse candidates once advertised, so every
+// hop still holds the route it passed on.
+template <typename Func>
+inline void for_each_path_hop(const AsnLookup& lookup, const std::vector<BGPState>& states,
+                              PrefixID prefix_id, const Announcement& ann, Func&& fn) {
+    const Announcement* cur = &ann;
+    for (uint16_t hops = 1; cur->rel != ORIGIN && hops < ann.path_len; ++hops) {
+        const uint32_t hop_idx = lookup.find(cur->next_hop);
+        if (hop_idx == AsnLookup::kNotFound || !states[hop_idx].has_route(prefix_id)) return;
+        fn(cur->next_hop);
+        cur = &states[hop_idx].rib[prefix_id];
+    }
+}
+
+// Appends the rows of the given nodes to out. Prefix IDs in states are local
+// to the batch and offset by prefix_base in prefixes; lanes selects the slots
+// of one ROV sweep scenario (all slots by default).
+void format_rib_rows(std::string& out, const ASGraph& graph, const AsnLookup& lookup,
+                     const std::vector<BGPState>& states, std::span<const uint32_t> nodes,
+                     const std::vector<std::string>& prefixes, PrefixID prefix_base, const LaneSlots& lanes = {});
+
+// Writes the rows of the given nodes in that order, the slots of lanes[l]
+// (one ROV sweep scenario each) to sinks[l]. Node ranges are formatted on the
+// pool into per-chunk buffers a few MiB at a time, so memory stays bounded
+// however large the batch is.
+void write_ribs(std::span<OutputSink> sinks, const ASGraph& graph, const AsnLookup& lookup,
+                const std::vector<BGPState>& states, std::span<const uint32_t> nodes,
+                const std::vector<std::string>& prefixes, PrefixID prefix_base, ThreadPool& pool,
+                std::span<const LaneSlots> lanes);
+
+// Writes every slot's rows to one sink
+inline void write_ribs(OutputSink& sink, const ASGraph& graph, const AsnLookup& lookup,
+                       const std::vector<BGPState>& states, std::span<const uint32_t> nodes,
+                       const std::vector<std::string>& prefixes, PrefixID prefix_base, ThreadPool& pool) {
+    const LaneSlots all;
+    write_ribs(std::span<OutputSink>(&sink, 1), graph, lookup, states, nodes, prefixes, prefix_base, pool,
+               std::span<const LaneSlots>(&all, 1));
+}
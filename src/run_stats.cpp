@@ -0,0 +1,176 @@
+#include "run_stats.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/resource.h>
+
+namespace {
+
+uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+double ms(uint64_t ns) { return ns / 1e6; }
+
+double utilization(const StepStats& s) { return s.thread_ns ? static_cast<double>(s.busy_ns) / s.thread_ns : 0.0; }
+
+StepStats sum(const std::vector<StepStats>& steps) {
+    StepStats total;
+    for (const StepStats& s : steps) total.add(s);
+    return total;
+}
+
+struct ProcessUsage {
+    long peak_rss_kb = 0;
+    double user_s = 0, sys_s = 0;
+};
+
+ProcessUsage process_usage() {
+    ProcessUsage u;
+    rusage ru{};
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+        u.peak_rss_kb = ru.ru_maxrss;  // kilobytes on Linux
+        u.user_s = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+        u.sys_s = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    }
+    return u;
+}
+
+void step_json(std::ostream& out, const StepStats& s) {
+    out << "{\"calls\": " << s.calls << ", \"ases\": " << s.ases << ", \"ms\": " << ms(s.wall_ns)
+        << ", \"busy_ms\": " << ms(s.busy_ns) << ", \"utilization\": " << utilization(s) << "}";
+}
+
+}  // namespace
+
+void RibSizes::add(const std::vector<BGPState>& states) {
+    for (const BGPState& st : states) {
+        routes += st.num_routes;
+        max_per_as = std::max(max_per_as, st.num_routes);
+    }
+}
+
+void RibSizes::add(const RibSizes& other) {
+    routes += other.routes;
+    max_per_as = std::max(max_per_as, other.max_per_as);
+}
+
+RunStats::RunStats(bool enabled) : on(enabled) {
+    if (on) last_ns = now_ns();
+}
+
+void RunStats::lap(std::string_view phase) {
+    if (!on) return;
+    const uint64_t now = now_ns();
+    auto it = std::find_if(phases.begin(), phases.end(), [&](const auto& p) { return p.first == phase; });
+    if (it == phases.end()) it = phases.emplace(phases.end(), std::string(phase), 0);
+    it->second += now - last_ns;
+    last_ns = now;
+}
+
+void RunStats::add(const PropagationStats& lane_prop, const RibSizes& lane_ribs) {
+    if (!on) return;
+    prop.add(lane_prop);
+    ribs.add(lane_ribs);
+}
+
+void RunStats::set_shape(unsigned num_threads, std::size_t num_ases, std::size_t ranks, std::size_t num_prefixes,
+                         std::size_t num_batches) {
+    threads = num_threads;
+    ases = num_ases;
+    num_ranks = ranks;
+    prefixes = num_prefixes;
+    batches = num_batches;
+}
+
+void RunStats::print() const {
+    if (!on) return;
+    const ProcessUsage usage = process_usage();
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    out << "Stats: " << threads << " threads, " << ases << " ASes, " << num_ranks << " ranks, " << prefixes
+        << " prefixes in " << batches << (batches == 1 ? " batch\n" : " batches\n");
+    uint64_t total_ns = 0;
+    for (const auto& [name, ns] : phases) {
+        out << "  phase " << std::left << std::setw(20) << name << std::right << std::setw(10) << ms(ns) << " ms\n";
+        total_ns += ns;
+    }
+    out << "  phase " << std::left << std::setw(20) << "total" << std::right << std::setw(10) << ms(total_ns) << " ms\n";
+
+    // Lanes of concurrent batches each run on one thread, so their step times
+    // add up to thread time rather than wall time
+    const StepStats up = sum(prop.up), down = sum(prop.down);
+    out << "  propagate up " << ms(up.wall_ns) << " ms (" << 100 * utilization(up) << "% busy), peers "
+        << ms(prop.peer_receive.wall_ns) << " + " << ms(prop.peer_process.wall_ns) << " ms ("
+        << 100 * utilization(prop.peer_receive) << "% / " << 100 * utilization(prop.peer_process)
+        << "% busy), down " << ms(down.wall_ns) << " ms (" << 100 * utilization(down) << "% busy)\n";
+    // Each phase runs only the ASes of its own frontier, so a rank counts its
+    // ASes per phase (averaged over batches)
+    out << "  rank  up ases      up ms   busy  down ases    down ms   busy\n";
+    for (std::size_t r = 0; r < std::max(prop.up.size(), prop.down.size()); ++r) {
+        const StepStats u = r < prop.up.size() ? prop.up[r] : StepStats();
+        const StepStats d = r < prop.down.size() ? prop.down[r] : StepStats();
+        out << "  " << std::setw(4) << r << std::setw(9) << u.ases / std::max<uint64_t>(1, u.calls)
+            << std::setw(11) << ms(u.wall_ns) << std::setw(6) << 100 * utilization(u) << "%" << std::setw(11)
+            << d.ases / std::max<uint64_t>(1, d.calls) << std::setw(11) << ms(d.wall_ns) << std::setw(6)
+            << 100 * utilization(d) << "%\n";
+    }
+
+    const RouteCounters& c = prop.counters;
+    out << "  bgp_receive " << c.received << " calls, " << c.replaced << " replaced a queued candidate ("
+        << (c.received ? 100.0 * c.replaced / c.received : 0.0) << "%), " << c.rov_dropped << " dropped by ROV, "
+        << c.policy_dropped << " by other policies\n";
+    out << "  rib " << c.rib_updates << " updates, " << ribs.routes << " routes, largest " << ribs.max_per_as
+        << " per AS\n";
+    out << "  process peak RSS " << usage.peak_rss_kb / 1024.0 << " MiB, user " << std::setprecision(2)
+        << usage.user_s << " s, sys " << usage.sys_s << " s\n";
+    std::cerr << out.str();
+}
+
+bool RunStats::write_json(const std::string& path) const {
+    if (!on) return true;
+    const ProcessUsage usage = process_usage();
+    std::ostringstream json;
+    json << "{\n  \"config\": {\"threads\": " << threads << ", \"ases\": " << ases << ", \"ranks\": " << num_ranks
+         << ", \"prefixes\": " << prefixes << ", \"batches\": " << batches << "},\n  \"phases\": [";
+    uint64_t total_ns = 0;
+    for (std::size_t i = 0; i < phases.size(); ++i) {
+        json << (i ? ", " : "") << "{\"name\": \"" << phases[i].first << "\", \"ms\": " << ms(phases[i].second) << "}";
+        total_ns += phases[i].second;
+    }
+    json << "],\n  \"total_ms\": " << ms(total_ns) << ",\n  \"propagation\": {\n    \"up\": ";
+    step_json(json, sum(prop.up));
+    json << ",\n    \"peer_receive\": ";
+    step_json(json, prop.peer_receive);
+    json << ",\n    \"peer_process\": ";
+    step_json(json, prop.peer_process);
+    json << ",\n    \"down\": ";
+    step_json(json, sum(prop.down));
+    json << ",\n    \"ranks\": [\n";
+    const std::size_t rank_count = std::max(prop.up.size(), prop.down.size());
+    for (std::size_t r = 0; r < rank_count; ++r) {
+        json << "      {\"rank\": " << r << ", \"up\": ";
+        step_json(json, r < prop.up.size() ? prop.up[r] : StepStats());
+        json << ", \"down\": ";
+        step_json(json, r < prop.down.size() ? prop.down[r] : StepStats());
+        json << "}" << (r + 1 < rank_count ? "," : "") << "\n";
+    }
+    const RouteCounters& c = prop.counters;
+    json << "    ]\n  },\n  \"counters\": {\"receives\": " << c.received << ", \"replaced\": " << c.replaced
+         << ", \"rov_dropped\": " << c.rov_dropped << ", \"policy_dropped\": " << c.policy_dropped
+         << ", \"rib_updates\": " << c.rib_updates
+         << ", \"routes\": " << ribs.routes << ", \"max_routes_per_as\": " << ribs.max_per_as << "},\n"
+         << "  \"process\": {\"peak_rss_kb\": " << usage.peak_rss_kb << ", \"user_s\": " << usage.user_s
+         << ", \"sys_s\": " << usage.sys_s << "}\n}\n";
+
+    std::ofstream out(path);
+    if (!(out << json.str())) {
+        std::cerr << "Cannot write " << path << "\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,58 @@
+// Run statistics - per-phase wall times, propagation timings and engine counters (--stats)
+// Nothing is measured unless enabled; the report goes to stderr as text or to a JSON file
+#pragma once
+
+#include "bgp.h"
+#include "propagation.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Route counts of the RIBs after each propagated batch
+struct RibSizes {
+    uint64_t routes = 0;       // summed over ASes and batches
+    uint32_t max_per_as = 0;   // largest RIB of any AS in any batch
+
+    void add(const std::vector<BGPState>& states);
+    void add(const RibSizes& other);
+};
+
+class RunStats {
+public:
+    explicit RunStats(bool enabled);
+
+    bool enabled() const { return on; }
+
+    // Adds the wall time since the previous lap (or construction) to phase;
+    // phases keep the order in which they were first seen
+    void lap(std::string_view phase);
+
+    // Where propagate() adds its timings; nullptr when disabled
+    PropagationStats* propagation() { return on ? &prop : nullptr; }
+
+    // Called after each batch with the converged rows
+    void add_ribs(const std::vector<BGPState>& states) { if (on) ribs.add(states); }
+
+    // Folds in what a concurrent lane collected on its own
+    void add(const PropagationStats& lane_prop, const RibSizes& lane_ribs);
+
+    // Run shape shown in the report header
+    void set_shape(unsigned threads, std::size_t ases, std::size_t ranks, std::size_t prefixes,
+                   std::size_t batches);
+
+    // Text report (stderr) and JSON report; peak RSS and CPU times are read when called
+    void print() const;
+    bool write_json(const std::string& path) const;
+
+private:
+    bool on;
+    uint64_t last_ns = 0;
+    std::vector<std::pair<std::string, uint64_t>> phases;
+    PropagationStats prop;
+    RibSizes ribs;
+    unsigned threads = 0;
+    std::size_t ases = 0, num_ranks = 0, prefixes = 0, batches = 0;
+};
@@ -0,0 +1,333 @@
+#include "scenario.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool parse_ipv4(std::string_view text, uint32_t& addr) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    uint32_t a = 0;
+    for (int octet = 0; octet < 4; ++octet) {
+        if (octet > 0) {
+            if (p == end || *p != '.') return false;
+            ++p;
+        }
+        const char* start = p;
+        unsigned v = 0;
+        while (p != end && p - start < 3 && *p >= '0' && *p <= '9') v = v * 10 + static_cast<unsigned>(*p++ - '0');
+        if (p == start || v > 255) return false;
+        a = a << 8 | v;
+    }
+    if (p != end) return false;
+    addr = a;
+    return true;
+}
+
+bool parse_prefix(std::string_view text, PrefixKey& key) {
+    const std::size_t slash = text.find('/');
+    if (slash == std::string_view::npos || slash == 0) return false;
+    const std::string_view addr = text.substr(0, slash);
+    const std::string_view len_text = text.substr(slash + 1);
+    unsigned len = 0;
+    auto res = std::from_chars(len_text.data(), len_text.data() + len_text.size(), len);
+    if (res.ec != std::errc() || res.ptr != len_text.data() + len_text.size()) return false;
+
+    PrefixKey k;
+    if (addr.find(':') == std::string_view::npos) {
+        uint32_t a = 0;
+        if (len > 32 || !parse_ipv4(addr, a)) return false;
+        k.lo = a;
+        k.family = 4;
+    } else {
+        char buf[INET6_ADDRSTRLEN];
+        in6_addr a;
+        if (len > 128 || addr.size() >= sizeof(buf)) return false;
+        std::memcpy(buf, addr.data(), addr.size());
+        buf[addr.size()] = '\0';
+        if (inet_pton(AF_INET6, buf, &a) != 1) return false;
+        for (int i = 0; i < 8; ++i) {
+            k.hi = k.hi << 8 | a.s6_addr[i];
+            k.lo = k.lo << 8 | a.s6_addr[8 + i];
+        }
+        k.family = 6;
+    }
+    k.len = static_cast<uint8_t>(len);
+    key = k;
+    return true;
+}
+
+PrefixID PrefixTable::find(const PrefixKey& key) const {
+    if (slots.empty()) return kNotFound;
+    const uint32_t meta = meta_of(key);
+    for (std::size_t h = slot_of(key.hi, key.lo, meta);; h = (h + 1) & mask) {
+        const Slot& s = slots[h];
+        if (s.meta == 0) return kNotFound;
+        if (s.meta == meta && s.lo == key.lo && s.hi == key.hi) return s.id;
+    }
+}
+
+PrefixID PrefixTable::find_or_add(const PrefixKey& key, PrefixID next) {
+    if ((count + 1) * 2 > slots.size()) rehash(std::max<std::size_t>(16, slots.size() * 2));
+    const uint32_t meta = meta_of(key);
+    std::size_t h = slot_of(key.hi, key.lo, meta);
+    for (;; h = (h + 1) & mask) {
+        const Slot& s = slots[h];
+        if (s.meta == 0) break;
+        if (s.meta == meta && s.lo == key.lo && s.hi == key.hi) return s.id;
+    }
+    slots[h] = Slot{key.hi, key.lo, meta, next};
+    ++count;
+    return next;
+}
+
+void PrefixTable::reserve(std::size_t n) {
+    std::size_t capacity = 16;
+    while (capacity < n * 2) capacity <<= 1;
+    if (capacity > slots.size()) rehash(capacity);
+}
+
+void PrefixTable::rehash(std::size_t capacity) {
+    std::vector<Slot> old(capacity, Slot{0, 0, 0, 0});
+    old.swap(slots);
+    mask = capacity - 1;
+    for (const Slot& s : old) {
+        if (s.meta == 0) continue;
+        std::size_t h = slot_of(s.hi, s.lo, s.meta);
+        while (slots[h].meta != 0) h = (h + 1) & mask;
+        slots[h] = s;
+    }
+}
+
+PrefixID PrefixDict::intern(std::string_view prefix) {
+    PrefixKey key;
+    if (!parse_prefix(prefix, key)) key = PrefixKey{};
+    return intern(key, prefix);
+}
+
+PrefixID PrefixDict::intern(const PrefixKey& key, std::string_view prefix) {
+    const PrefixID next = static_cast<PrefixID>(names.size());
+    const PrefixID id = key.family ? ids.find_or_add(key, next)
+                                   : other_ids.try_emplace(std::string(prefix), next).first->second;
+    if (id == next) names.emplace_back(prefix);
+    return id;
+}
+
+static std::string_view trim(std::string_view v) {
+    auto start = v.find_first_not_of(" \t\r\n");
+    if (start == std::string_view::npos) return std::string_view();
+    auto end = v.find_last_not_of(" \t\r\n");
+    return v.substr(start, end - start + 1);
+}
+
+InputFile::~InputFile() {
+    if (map) munmap(map, map_size);
+}
+
+bool InputFile::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        const std::size_t size = static_cast<std::size_t>(st.st_size);
+        void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            close(fd);
+            map = p;
+            map_size = size;
+            view = std::string_view(static_cast<const char*>(p), size);
+            return true;
+        }
+    }
+    char block[1 << 16];
+    ssize_t n;
+    while ((n = read(fd, block, sizeof(block))) > 0) buffer.append(block, static_cast<std::size_t>(n));
+    close(fd);
+    if (n < 0) return false;
+    view = buffer;
+    return true;
+}
+
+namespace {
+
+// Below this many bytes per chunk, splitting costs more than it saves
+constexpr std::size_t kMinChunkBytes = std::size_t{256} << 10;
+
+// Cuts text into pieces of similar size that end at line ends, enough to keep
+// every thread of the pool busy
+std::vector<std::string_view> split_lines(std::string_view text, const ThreadPool& pool) {
+    const std::size_t parts = std::max<std::size_t>(
+        1, std::min<std::size_t>(std::size_t{pool.size()} * 4, text.size() / kMinChunkBytes));
+    std::vector<std::string_view> pieces;
+    std::size_t begin = 0;
+    for (std::size_t p = 1; p <= parts && begin < text.size(); ++p) {
+        std::size_t end = text.size();
+        if (p < parts) {
+            end = text.find('\n', std::max(begin, text.size() / parts * p));
+            end = end == std::string_view::npos ? text.size() : end + 1;
+        }
+        pieces.push_back(text.substr(begin, end - begin));
+        begin = end;
+    }
+    return pieces;
+}
+
+template <typename Fn>
+void for_each_line(std::string_view text, Fn&& fn) {
+    while (!text.empty()) {
+        const std::size_t nl = text.find('\n');
+        fn(text.substr(0, nl));
+        if (nl == std::string_view::npos) break;
+        text.remove_prefix(nl + 1);
+    }
+}
+
+void parse_ann_chunk(std::string_view text, const PrefixDict* wanted, AnnChunk& chunk) {
+    PrefixTable local_ids;
+    std::unordered_map<std::string_view, PrefixID> local_other_ids;
+
+    for_each_line(text, [&](std::string_view line) {
+        if (line.empty()) return;
+        // Expected format: ASN,prefix,rov_invalid
+        size_t first_comma = line.find(',');
+        if (first_comma == std::string_view::npos) return;
+        size_t second_comma = line.find(',', first_comma + 1);
+        if (second_comma == std::string_view::npos) return;
+
+        std::string_view asn_view = trim(line.substr(0, first_comma));
+        std::string_view prefix_view = trim(line.substr(first_comma + 1, second_comma - first_comma - 1));
+        std::string_view rov_view = trim(line.substr(second_comma + 1));
+        if (asn_view.empty() || prefix_view.empty() || rov_view.empty()) return;
+
+        ASN origin_asn = 0;
+        auto asn_res = std::from_chars(asn_view.data(), asn_view.data() + asn_view.size(), origin_asn);
+        if (asn_res.ec != std::errc()) return;
+
+        bool rov_invalid = (rov_view == "True" || rov_view == "true" || rov_view == "1");
+
+        PrefixKey key;
+        if (!parse_prefix(prefix_view, key)) key = PrefixKey{};
+
+        // Prefixes never interact, so unrequested ones are not simulated at all
+        if (wanted && (key.family ? wanted->ids.find(key) == PrefixTable::kNotFound
+                                  : !wanted->other_ids.count(std::string(prefix_view)))) {
+            return;
+        }
+
+        const PrefixID next = static_cast<PrefixID>(chunk.prefixes.size());
+        const PrefixID id = key.family ? local_ids.find_or_add(key, next)
+                                       : local_other_ids.try_emplace(prefix_view, next).first->second;
+        if (id == next) chunk.prefixes.push_back(AnnChunk::Prefix{key, prefix_view});
+
+        Announcement ann;
+        ann.next_hop = origin_asn;
+        ann.path_len = 1;
+        ann.rel = ORIGIN;
+        ann.rov_invalid = rov_invalid;
+
+        chunk.seeds.push_back(Seed{AsnLookup::kNotFound, id, ann});
+    });
+}
+
+}  // namespace
+
+std::unordered_set<ASN> load_rov_asns(const std::string& path, ThreadPool& pool) {
+    std::unordered_set<ASN> rov_asns;
+    InputFile file;
+    if (!file.open(path)) return rov_asns;
+
+    const std::vector<std::string_view> pieces = split_lines(file.text(), pool);
+    std::vector<std::vector<ASN>> parsed(pieces.size());
+    pool.parallel_for(pieces.size(), [&](std::size_t i) { return pieces[i].size(); }, [&](std::size_t i) {
+        for_each_line(pieces[i], [&](std::string_view line) {
+            if (line.empty() || line[0] == '#') return;
+            std::string_view v = trim(line);
+            if (v.empty()) return;
+            ASN asn = 0;
+            auto res = std::from_chars(v.data(), v.data() + v.size(), asn);
+            if (res.ec != std::errc()) return;
+            parsed[i].push_back(asn);
+        });
+    });
+
+    std::size_t total = 0;
+    for (const auto& asns : parsed) total += asns.size();
+    rov_asns.reserve(total);
+    for (const auto& asns : parsed) rov_asns.insert(asns.begin(), asns.end());
+    return rov_asns;
+}
+
+bool parse_announcements(const std::string& path, const std::unordered_set<std::string>& only_prefixes,
+                         ParsedAnnouncements& parsed, ThreadPool& pool) {
+    if (!parsed.file.open(path)) return false;
+
+    // Header line skipped
+    std::string_view body = parsed.file.text();
+    const std::size_t header_end = body.find('\n');
+    body.remove_prefix(header_end == std::string_view::npos ? body.size() : header_end + 1);
+
+    // --only-prefixes matches by value like the dictionary
+    PrefixDict wanted;
+    for (const std::string& prefix : only_prefixes) wanted.intern(prefix);
+
+    const std::vector<std::string_view> pieces = split_lines(body, pool);
+    parsed.chunks.assign(pieces.size(), AnnChunk());
+    pool.parallel_for(pieces.size(), [&](std::size_t i) { return pieces[i].size(); }, [&](std::size_t i) {
+        parse_ann_chunk(pieces[i], only_prefixes.empty() ? nullptr : &wanted, parsed.chunks[i]);
+    });
+    return true;
+}
+
+void resolve_announcements(ParsedAnnouncements& parsed, const AsnLookup& lookup, PrefixDict& dict,
+                           std::vector<Seed>& seeds, ThreadPool& pool) {
+    std::vector<AnnChunk>& chunks = parsed.chunks;
+    std::vector<std::size_t> kept(chunks.size(), 0);
+    pool.parallel_for(chunks.size(), [&](std::size_t i) { return chunks[i].seeds.size(); }, [&](std::size_t i) {
+        for (Seed& seed : chunks[i].seeds) {
+            seed.node = lookup.find(seed.ann.next_hop);
+            kept[i] += seed.node != AsnLookup::kNotFound;
+        }
+    });
+
+    // Chunks are merged in file order, each in its own order of first
+    // appearance, so IDs come out in global order of first appearance. A
+    // prefix only gets an ID once a row with a known origin announces it.
+    std::vector<std::size_t> offsets(chunks.size() + 1, seeds.size());
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+        AnnChunk& chunk = chunks[i];
+        if (kept[i] == chunk.seeds.size()) {
+            chunk.global_ids.reserve(chunk.prefixes.size());
+            for (const AnnChunk::Prefix& p : chunk.prefixes) chunk.global_ids.push_back(dict.intern(p.key, p.text));
+        } else {
+            chunk.global_ids.assign(chunk.prefixes.size(), PrefixTable::kNotFound);
+            for (const Seed& seed : chunk.seeds) {
+                PrefixID& id = chunk.global_ids[seed.prefix_id];
+                if (seed.node == AsnLookup::kNotFound || id != PrefixTable::kNotFound) continue;
+                id = dict.intern(chunk.prefixes[seed.prefix_id].key, chunk.prefixes[seed.prefix_id].text);
+            }
+        }
+        offsets[i + 1] = offsets[i] + kept[i];
+    }
+
+    seeds.resize(offsets.back());
+    pool.parallel_for(chunks.size(), [&](std::size_t i) { return chunks[i].seeds.size(); }, [&](std::size_t i) {
+        const AnnChunk& chunk = chunks[i];
+        Seed* out = seeds.data() + offsets[i];
+        for (const Seed& seed : chunk.seeds) {
+            if (seed.node != AsnLookup::kNotFound) *out++ = Seed{seed.node, chunk.global_ids[seed.prefix_id], seed.ann};
+        }
+    });
+}
+
+bool load_announcements(const std::string& path, const AsnLookup& lookup,
+                        const std::unordered_set<std::string>& only_prefixes, PrefixDict& dict,
+                        std::vector<Seed>& seeds, ThreadPool& pool) {
+    ParsedAnnouncements parsed;
+    if (!parse_announcements(path, only_prefixes, parsed, pool)) return false;
+    resolve_announcements(parsed, lookup, dict, seeds, pool);
+    return true;
+}
@@ -0,0 +1,142 @@
+// Scenario inputs - parses an announcements file and a ROV file into origin seeds for one run
+// Shared by the one-shot simulator and the batch/server mode
+#pragma once
+
+#include "announcement.h"
+#include "as_graph.h"
+#include "rib_writer.h"
+#include "thread_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Numeric key of an IP prefix: address bits (IPv4 in the low 32 bits of lo)
+// and length. family is 4 or 6, or 0 for text that is not an IP prefix.
+struct PrefixKey {
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+    uint8_t len = 0;
+    uint8_t family = 0;
+};
+
+// PrefixKey -> PrefixID table for IP prefixes (family 4 or 6): open addressing
+// over one flat array like AsnLookup, at most half full
+class PrefixTable {
+public:
+    static constexpr PrefixID kNotFound = UINT32_MAX;
+
+    PrefixID find(const PrefixKey& key) const;
+    // ID of key; if key is new it is added with ID next
+    PrefixID find_or_add(const PrefixKey& key, PrefixID next);
+    void reserve(std::size_t n);
+    std::size_t size() const { return count; }
+
+private:
+    struct Slot {
+        uint64_t hi;
+        uint64_t lo;
+        uint32_t meta;  // family << 8 | len, 0 if unused
+        PrefixID id;
+    };
+    static uint32_t meta_of(const PrefixKey& k) { return uint32_t{k.family} << 8 | k.len; }
+    std::size_t slot_of(uint64_t hi, uint64_t lo, uint32_t meta) const {
+        uint64_t h = (hi * 0x9E3779B97F4A7C15ULL) ^ lo ^ (uint64_t{meta} << 40);
+        h = (h ^ (h >> 33)) * 0xFF51AFD7ED558CCDULL;
+        return static_cast<std::size_t>(h ^ (h >> 33)) & mask;
+    }
+    void rehash(std::size_t capacity);
+
+    std::vector<Slot> slots;
+    std::size_t mask = 0;
+    std::size_t count = 0;
+};
+
+// Parses a dotted-quad IPv4 address (octets of at most 3 digits, no blanks)
+bool parse_ipv4(std::string_view text, uint32_t& addr);
+
+// Parses "a.b.c.d/len" or "ipv6-address/len" (surrounding blanks not allowed).
+// Host bits are kept, so 10.0.0.1/8 and 10.0.0.0/8 stay distinct prefixes.
+bool parse_prefix(std::string_view text, PrefixKey& key);
+
+// Prefix dictionary of one run: IDs are handed out in order of first appearance.
+// IP prefixes are keyed by value, so two spellings of one prefix share an ID
+// and keep the first spelling as name; anything else is keyed by its text.
+struct PrefixDict {
+    PrefixTable ids;
+    std::unordered_map<std::string, PrefixID> other_ids;
+    std::vector<std::string> names;
+
+    PrefixID intern(std::string_view prefix);
+    // key is parse_prefix(prefix), or a family 0 key if it did not parse
+    PrefixID intern(const PrefixKey& key, std::string_view prefix);
+};
+
+// Origin announcement parsed from anns.csv (prefix_id is global until split into batches)
+struct Seed {
+    uint32_t node;
+    PrefixID prefix_id;
+    Announcement ann;
+};
+
+// Whole input file: mapped if it is a non-empty regular file, read otherwise (pipes)
+class InputFile {
+public:
+    InputFile() = default;
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+    ~InputFile();
+
+    bool open(const std::string& path);
+    std::string_view text() const { return view; }
+
+private:
+    void* map = nullptr;
+    std::size_t map_size = 0;
+    std::string buffer;
+    std::string_view view;
+};
+
+// Seeds of one chunk of anns.csv; their prefix_id indexes the chunk's own
+// prefixes (in order of first appearance) until the chunks are merged
+struct AnnChunk {
+    struct Prefix {
+        PrefixKey key;
+        std::string_view text;
+    };
+    std::vector<Seed> seeds;
+    std::vector<Prefix> prefixes;
+    std::vector<PrefixID> global_ids;  // per chunk prefix, filled by the merge
+};
+
+// anns.csv parsed without the graph: the seeds' origins are still ASNs
+// (ann.next_hop) and their prefixes point into file
+struct ParsedAnnouncements {
+    InputFile file;
+    std::vector<AnnChunk> chunks;
+};
+
+// ASNs listed in a ROV file, one per line ('#' starts a comment line).
+// A missing file means no AS deploys ROV.
+std::unordered_set<ASN> load_rov_asns(const std::string& path, ThreadPool& pool);
+
+// Parses the "asn,prefix,rov_invalid" rows of path (header skipped) in chunks
+// on pool. Needs no graph, so it can run while the graph loads. If
+// only_prefixes is not empty, other prefixes are dropped. False if path cannot
+// be opened.
+bool parse_announcements(const std::string& path, const std::unordered_set<std::string>& only_prefixes,
+                         ParsedAnnouncements& parsed, ThreadPool& pool);
+
+// Appends one seed per parsed row whose origin is in the graph (looked up in
+// lookup), in file order, and gives their prefixes IDs in dict in order of
+// first appearance among those rows, so IDs do not depend on the pool size.
+void resolve_announcements(ParsedAnnouncements& parsed, const AsnLookup& lookup, PrefixDict& dict,
+                           std::vector<Seed>& seeds, ThreadPool& pool);
+
+// parse_announcements followed by resolve_announcements
+bool load_announcements(const std::string& path, const AsnLookup& lookup,
+                        const std::unordered_set<std::string>& only_prefixes, PrefixDict& dict,
+                        std::vector<Seed>& seeds, ThreadPool& pool);
@@ -0,0 +1,337 @@
+#include "server.h"
+#include "bgp.h"
+#include "propagation.h"
+#include "result_store.h"
+#include "scenario.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+// One socket client; the descriptor is closed once the reader and every
+// queued job of the client are done with it
+struct Client {
+    int fd;
+    std::mutex write_mutex;
+
+    explicit Client(int fd) : fd(fd) {}
+    ~Client() { ::close(fd); }
+
+    void reply(const std::string& line) {
+        std::lock_guard<std::mutex> lk(write_mutex);
+        std::size_t done = 0;
+        while (done < line.size()) {
+            const ssize_t n = ::send(fd, line.data() + done, line.size() - done, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return;  // client went away; the job still ran
+            done += static_cast<std::size_t>(n);
+        }
+    }
+};
+
+struct Job {
+    std::string anns_path;
+    std::string rov_path;
+    std::string output_path;  // "-" = no CSV
+    std::string store_path;   // empty = no result store
+    std::shared_ptr<Client> client;  // nullptr = reply on stdout
+};
+
+class JobQueue {
+public:
+    // False (leaving job untouched) if the queue is already closed
+    bool push(Job&& job) {
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            if (closed) return false;
+            jobs.push_back(std::move(job));
+        }
+        cv.notify_one();
+        return true;
+    }
+
+    // Blocks until a job is available; false once the queue is closed and drained
+    bool pop(Job& job) {
+        std::unique_lock<std::mutex> lk(mutex);
+        cv.wait(lk, [&] { return closed || !jobs.empty(); });
+        if (jobs.empty()) return false;
+        job = std::move(jobs.front());
+        jobs.pop_front();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Job> jobs;
+    bool closed = false;
+};
+
+std::mutex stdout_mutex;
+
+void send_reply(const Job& job, const std::string& line) {
+    if (job.client) {
+        job.client->reply(line);
+        return;
+    }
+    std::lock_guard<std::mutex> lk(stdout_mutex);
+    std::cout << line << std::flush;
+}
+
+// Splits a job line into its fields; false (with a reply text) if it is malformed
+bool parse_job(const std::string& line, Job& job, std::string& error) {
+    std::istringstream in(line);
+    std::vector<std::string> fields;
+    for (std::string field; in >> field;) fields.push_back(std::move(field));
+    if (fields.size() < 3 || fields.size() > 4) {
+        error = "error " + line + ": expected <anns.csv> <rov_asns.csv> <output.csv|-> [result-store]\n";
+        return false;
+    }
+    job.anns_path = std::move(fields[0]);
+    job.rov_path = std::move(fields[1]);
+    job.output_path = std::move(fields[2]);
+    if (fields.size() == 4) job.store_path = std::move(fields[3]);
+    if (job.output_path == "-" && job.store_path.empty()) {
+        error = "error " + job.anns_path + ": job writes neither a CSV nor a result store\n";
+        return false;
+    }
+    return true;
+}
+
+// State a worker keeps between jobs: the rows are rebound, not reallocated,
+// whenever the next job has no more prefixes than the largest one so far
+struct Worker {
+    std::vector<BGPState> states;
+    BGPTable table;
+    ThreadPool serial{1};
+
+    explicit Worker(bool huge_pages) : table(huge_pages) {}
+};
+
+// Runs one scenario on the worker's own rows and returns its reply line
+std::string run_job(const ServeContext& ctx, const std::vector<uint32_t>& store_nodes, Worker& w,
+                    const Job& job) {
+    const auto start = std::chrono::steady_clock::now();
+    const ASGraph& graph = *ctx.graph;
+
+    const std::unordered_set<ASN> rov_asns = load_rov_asns(job.rov_path, w.serial);
+    std::vector<ASN> graph_rov_asns;
+    for (uint32_t idx = 0; idx < graph.nodes.size(); ++idx) {
+        w.states[idx].policy = rov_asns.count(graph.nodes[idx].asn) > 0 ? POLICY_ROV : 0;
+        if (w.states[idx].policy) graph_rov_asns.push_back(graph.nodes[idx].asn);
+    }
+    std::sort(graph_rov_asns.begin(), graph_rov_asns.end());
+
+    PrefixDict dict;
+    std::vector<Seed> seeds;
+    if (!load_announcements(job.anns_path, *ctx.lookup, *ctx.only_prefixes, dict, seeds, w.serial)) {
+        return "error " + job.anns_path + ": cannot open announcements file\n";
+    }
+
+    w.table.init(w.states, dict.names.size());
+    for (const Seed& seed : seeds) bgp_originate(w.states[seed.node], seed.prefix_id, seed.ann);
+    propagate(graph, *ctx.ranks, w.states, w.serial);
+
+    if (job.output_path != "-") {
+        OutputSink sink;
+        if (!sink.open(job.output_path)) return "error " + job.anns_path + ": cannot create " + job.output_path + "\n";
+        sink.write("asn,prefix,as_path\n");
+        write_ribs(sink, graph, *ctx.lookup, w.states, ctx.output_nodes, dict.names, 0, w.serial);
+        if (!sink.ok()) return "error " + job.anns_path + ": writing " + job.output_path + " failed\n";
+    }
+    if (!job.store_path.empty()) {
+        std::vector<ASN> store_asns(store_nodes.size());
+        for (std::size_t k = 0; k < store_nodes.size(); ++k) store_asns[k] = graph.nodes[store_nodes[k]].asn;
+        std::vector<AnnRow> ann_rows;
+        ann_rows.reserve(seeds.size());
+        for (const Seed& seed : seeds) {
+            ann_rows.push_back(AnnRow{seed.ann.next_hop, seed.prefix_id, seed.ann.rov_invalid ? 1u : 0u});
+        }
+        ResultStoreWriter store;
+        StoreSegment segment;
+        if (!store.open(job.store_path, std::move(store_asns))) {
+            return "error " + job.anns_path + ": cannot create " + job.store_path + "\n";
+        }
+        build_store_segment(segment, *ctx.lookup, w.states, store_nodes, 0, dict.names.size(), w.serial);
+        store.append(segment);
+        if (!store.finish(dict.names, ctx.source_hash, ann_rows, graph_rov_asns)) {
+            return "error " + job.anns_path + ": writing " + job.store_path + " failed\n";
+        }
+    }
+
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    return "ok " + (job.output_path != "-" ? job.output_path : job.store_path) + " " +
+           std::to_string(dict.names.size()) + " " + std::to_string(ms.count()) + "\n";
+}
+
+// Queues the jobs of one input line; returns false for "shutdown"
+bool handle_line(std::string line, const std::shared_ptr<Client>& client, JobQueue& queue) {
+    const auto first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#') return true;
+    line.erase(0, first);
+    line.erase(line.find_last_not_of(" \t\r") + 1);
+    if (line == "shutdown") return false;
+
+    Job job;
+    job.client = client;
+    std::string error;
+    if (!parse_job(line, job, error)) {
+        send_reply(job, error);
+    } else if (!queue.push(std::move(job))) {
+        send_reply(job, "error " + job.anns_path + ": server is shutting down\n");
+    }
+    return true;
+}
+
+// Accepts clients until one of them sends "shutdown". Every client gets its
+// own reader thread; all readers have finished when this returns.
+void accept_clients(int listen_fd, JobQueue& queue) {
+    std::mutex clients_mutex;
+    std::condition_variable readers_done;
+    std::vector<std::weak_ptr<Client>> clients;
+    std::size_t active_readers = 0;
+    bool stopping = false;
+
+    auto stop = [&] {
+        std::lock_guard<std::mutex> lk(clients_mutex);
+        if (stopping) return;
+        stopping = true;
+        queue.close();
+        ::shutdown(listen_fd, SHUT_RDWR);  // wakes the accept() below
+        for (auto& weak : clients) {
+            if (auto client = weak.lock()) ::shutdown(client->fd, SHUT_RD);
+        }
+    };
+
+    auto read_client = [&](const std::shared_ptr<Client>& client) {
+        std::string pending;
+        char buf[1 << 16];
+        bool more = true;
+        while (more) {
+            const ssize_t n = ::read(client->fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            pending.append(buf, static_cast<std::size_t>(n));
+            std::size_t begin = 0;
+            for (std::size_t nl; more && (nl = pending.find('\n', begin)) != std::string::npos; begin = nl + 1) {
+                more = handle_line(pending.substr(begin, nl - begin), client, queue);
+            }
+            pending.erase(0, begin);
+        }
+        if (!more || (!pending.empty() && !handle_line(pending, client, queue))) stop();
+    };
+
+    for (;;) {
+        const int fd = ::accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        auto client = std::make_shared<Client>(fd);
+        {
+            std::lock_guard<std::mutex> lk(clients_mutex);
+            if (stopping) break;  // connected after shutdown; dropping client closes it
+            std::erase_if(clients, [](const std::weak_ptr<Client>& weak) { return weak.expired(); });
+            clients.push_back(client);
+            ++active_readers;
+        }
+        std::thread([&, client] {
+            read_client(client);
+            std::lock_guard<std::mutex> lk(clients_mutex);
+            if (--active_readers == 0) readers_done.notify_all();
+        }).detach();
+    }
+    stop();
+    std::unique_lock<std::mutex> lk(clients_mutex);
+    readers_done.wait(lk, [&] { return active_readers == 0; });
+}
+
+int listen_unix(const std::string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Socket path too long: " << path << "\n";
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "Failed to create socket: " << std::strerror(errno) << "\n";
+        return -1;
+    }
+    ::unlink(path.c_str());  // stale socket of an earlier server
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 64) != 0) {
+        std::cerr << "Failed to listen on " << path << ": " << std::strerror(errno) << "\n";
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+}  // namespace
+
+int serve_scenarios(const ServeContext& ctx, ThreadPool& pool, const std::string& socket_path) {
+    // Result stores list their nodes by ASN
+    std::vector<uint32_t> store_nodes(ctx.output_nodes.begin(), ctx.output_nodes.end());
+    std::sort(store_nodes.begin(), store_nodes.end(), [&](uint32_t a, uint32_t b) {
+        return ctx.graph->nodes[a].asn < ctx.graph->nodes[b].asn;
+    });
+
+    JobQueue queue;
+    int listen_fd = -1;
+    if (!socket_path.empty()) {
+        listen_fd = listen_unix(socket_path);
+        if (listen_fd < 0) return 1;
+        std::cerr << "Listening on " << socket_path << "\n";
+    }
+    std::thread feeder([&] {
+        if (listen_fd >= 0) {
+            accept_clients(listen_fd, queue);
+            return;
+        }
+        for (std::string line; std::getline(std::cin, line);) {
+            if (!handle_line(std::move(line), nullptr, queue)) break;
+        }
+        queue.close();
+    });
+
+    // Every thread of the pool works through jobs on its own rows
+    pool.parallel_for(pool.size(), [](std::size_t) { return 1; }, [&](std::size_t) {
+        Worker worker(ctx.huge_pages);
+        worker.states.resize(ctx.graph->nodes.size());
+        for (;;) {
+            // Scoped to one job: a job kept alive while pop() blocks would keep
+            // its client's connection open after the last reply
+            Job job;
+            if (!queue.pop(job)) break;
+            send_reply(job, run_job(ctx, store_nodes, worker, job));
+        }
+    });
+
+    feeder.join();
+    if (listen_fd >= 0) {
+        ::close(listen_fd);
+        ::unlink(socket_path.c_str());
+    }
+    return 0;
+}
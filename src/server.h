@@ -0,0 +1,32 @@
+// Batch/server mode - simulates many scenarios against one loaded graph
+// Jobs arrive on stdin or a UNIX socket; each worker keeps its state arrays across jobs
+#pragma once
+
+#include "as_graph.h"
+#include "rib_writer.h"
+#include "thread_pool.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Everything the jobs share; set up once by main
+struct ServeContext {
+    const ASGraph* graph = nullptr;
+    const std::vector<std::vector<uint32_t>>* ranks = nullptr;
+    const AsnLookup* lookup = nullptr;
+    std::span<const uint32_t> output_nodes;                  // rows written per job (--only-asns), node order
+    const std::unordered_set<std::string>* only_prefixes = nullptr;  // --only-prefixes, empty = all
+    uint64_t source_hash = 0;                                // recorded in result stores
+    bool huge_pages = false;                                 // --huge-pages for the workers' tables
+};
+
+// Reads job lines "<anns.csv> <rov_asns.csv> <output.csv|-> [result-store]"
+// from stdin (socket_path empty) or from clients of a UNIX socket at
+// socket_path, and runs them on pool.size() workers, one job per worker at a
+// time. Every job gets one reply line, "ok <output> <prefixes> <ms>" or
+// "error <anns.csv>: <reason>", on stdout or its connection. A client line
+// "shutdown" stops the socket server once queued jobs are done; stdin mode
+// ends at end of input. Returns the process exit code.
+int serve_scenarios(const ServeContext& ctx, ThreadPool& pool, const std::string& socket_path);
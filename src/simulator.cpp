@@ -1,279 +1,522 @@
 #include "as_graph.h"
 #include "announcement.h"
 #include "bgp.h"
-#include <fstream>
+#include "graph_snapshot.h"
+#include "incremental.h"
+#include "policy.h"
+#include "propagation.h"
+#include "result_store.h"
+#include "rib_writer.h"
+#include "run_stats.h"
+#include "scenario.h"
+#include "server.h"
+#include "sweep.h"
+#include "thread_pool.h"
 #include <iostream>
 #include <unordered_set>
 #include <memory>
 #include <algorithm>
+#include <numeric>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <unordered_map>
 #include <string>
 #include <string_view>
 #include <charconv>
 #include <thread>
 
-// Global prefix dictionary for this simulation run
-static std::unordered_map<std::string, PrefixID> g_prefix_to_id;
-static std::vector<std::string> g_id_to_prefix;
+// Concurrent batches: finished but unwritten batches allowed per thread
+static constexpr std::size_t kReorderWindow = 2;
 
-static PrefixID get_prefix_id(const std::string& prefix) {
-    auto it = g_prefix_to_id.find(prefix);
-    if (it != g_prefix_to_id.end()) return it->second;
-    PrefixID id = static_cast<PrefixID>(g_id_to_prefix.size());
-    g_id_to_prefix.push_back(prefix);
-    g_prefix_to_id.emplace(prefix, id);
-    return id;
+// Calls fn for every non-empty item of a comma-separated list
+template <typename Func>
+static void for_each_list_item(std::string_view list, Func&& fn) {
+    while (!list.empty()) {
+        std::size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        if (!item.empty()) fn(item);
+        if (comma == std::string_view::npos) break;
+        list.remove_prefix(comma + 1);
+    }
 }
 
-static void send_announcements(ASGraph& graph, uint32_t from_idx, const std::vector<uint32_t>& targets, Rel rel_type) {
-    if (from_idx >= graph.nodes.size()) return;
-    ASNode& from_node = graph.nodes[from_idx];
-    if (!from_node.state) return;
-    ASN from_asn = from_node.asn;
-    for (const auto& [prefix_id, ann] : from_node.state->rib) {
-        for (uint32_t target_idx : targets) {
-            if (target_idx >= graph.nodes.size()) continue;
-            ASNode& target_node = graph.nodes[target_idx];
-            if (!target_node.state) continue;
-            Announcement new_ann = ann;
-            new_ann.next_hop = from_asn;
-            new_ann.rel = rel_type;
-            bgp_receive(*target_node.state, prefix_id, new_ann);
-        }
+// Seeds and propagates one batch of prefixes. states keeps its policies
+// across batches; table is rebound (and its slots reused) for each batch.
+static void run_batch(const ASGraph& graph, const std::vector<std::vector<uint32_t>>& ranks,
+                      std::vector<BGPState>& states, BGPTable& table, ThreadPool& pool,
+                      const std::vector<Seed>& seeds, std::size_t num_prefixes, PropagationStats* stats,
+                      const PolicyContext* policies) {
+    table.init(states, num_prefixes);
+    for (const Seed& seed : seeds) {
+        bgp_originate(states[seed.node], seed.prefix_id, seed.ann);
     }
+    propagate(graph, ranks, states, pool, stats, policies);
 }
 
-// Helper: parallel for over a vector of node indices. For num_threads <= 1,
-// executes sequentially to avoid thread overhead.
-template <typename Func>
-static void parallel_for_indices(const std::vector<uint32_t>& indices,
-                                 unsigned num_threads,
-                                 Func&& fn) {
-    if (indices.empty()) return;
-    if (num_threads <= 1 || indices.size() < 2) {
-        for (uint32_t idx : indices) {
-            fn(idx);
+int main(int argc, char* argv[]) {
+    // Positional: <anns.csv> <rov_asns.csv> [threads]; options may appear anywhere
+    std::vector<std::string_view> positional;
+    std::size_t prefix_batch = 0;
+    const std::string caida_path = "data/as-rel.txt.bz2";
+    std::string graph_cache = caida_path + ".snapshot";
+    std::string output_path;  // empty = stdout
+    std::string store_path;   // empty = no result store
+    std::string baseline_path;  // empty = full simulation
+    bool batch_mode = false;    // jobs from stdin
+    std::string socket_path;    // jobs from a UNIX socket
+    bool write_csv = true;
+    bool huge_pages = false;    // back RIB tables with transparent huge pages
+    bool print_stats = false;   // --stats: report on stderr
+    std::string stats_json;     // --stats-json: report as JSON
+    std::string policies_path;  // --policies: per-AS import policies
+    std::string aspa_path;      // --aspa: published ASPA records
+    bool collapse = false;      // --collapse-stubs: fold single-homed stubs into their providers
+    std::string sweep_path;     // --sweep: ROV scenarios propagated in lockstep
+    std::string_view only_asns_arg;
+    std::string_view only_prefixes_arg;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg(argv[i]);
+        if (arg == "--graph-cache" && i + 1 < argc) {
+            graph_cache = argv[++i];
+        } else if (arg == "--output" && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (arg == "--result-store" && i + 1 < argc) {
+            store_path = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (arg == "--batch") {
+            batch_mode = true;
+        } else if (arg == "--socket" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (arg == "--huge-pages") {
+            huge_pages = true;
+        } else if (arg == "--stats") {
+            print_stats = true;
+        } else if (arg == "--stats-json" && i + 1 < argc) {
+            stats_json = argv[++i];
+        } else if (arg == "--policies" && i + 1 < argc) {
+            policies_path = argv[++i];
+        } else if (arg == "--aspa" && i + 1 < argc) {
+            aspa_path = argv[++i];
+        } else if (arg == "--sweep" && i + 1 < argc) {
+            sweep_path = argv[++i];
+        } else if (arg == "--collapse-stubs") {
+            collapse = true;
+        } else if (arg == "--no-csv") {
+            write_csv = false;
+        } else if (arg == "--only-asns" && i + 1 < argc) {
+            only_asns_arg = argv[++i];
+        } else if (arg == "--only-prefixes" && i + 1 < argc) {
+            only_prefixes_arg = argv[++i];
+        } else if (arg == "--no-graph-cache") {
+            graph_cache.clear();
+        } else if (arg == "--prefix-batch" && i + 1 < argc) {
+            std::string_view v(argv[++i]);
+            auto res = std::from_chars(v.data(), v.data() + v.size(), prefix_batch);
+            if (res.ec != std::errc()) {
+                std::cerr << "Invalid --prefix-batch value: " << v << "\n";
+                return 1;
+            }
+        } else {
+            positional.push_back(arg);
         }
-        return;
     }
-
-    unsigned threads = std::min<unsigned>(num_threads, static_cast<unsigned>(indices.size()));
-    std::vector<std::thread> workers;
-    workers.reserve(threads);
-
-    std::size_t total = indices.size();
-    std::size_t base = total / threads;
-    std::size_t rem = total % threads;
-    std::size_t begin = 0;
-
-    for (unsigned t = 0; t < threads; ++t) {
-        std::size_t chunk = base + (t < rem ? 1 : 0);
-        std::size_t end = begin + chunk;
-        workers.emplace_back([begin, end, &indices, &fn]() {
-            for (std::size_t i = begin; i < end; ++i) {
-                fn(indices[i]);
-            }
-        });
-        begin = end;
+    // --batch / --socket: the only positional argument is the thread count;
+    // --sweep: the sweep file replaces <rov_asns.csv>
+    const bool serve = batch_mode || !socket_path.empty();
+    const bool sweep_mode = !sweep_path.empty();
+    const std::size_t num_inputs = serve ? 0 : (sweep_mode ? 1 : 2);
+    if (positional.size() < num_inputs) {
+        std::cerr << "Usage: " << argv[0] << " <anns.csv> <rov_asns.csv> [threads] [--prefix-batch N]"
+                  << " [--graph-cache PATH | --no-graph-cache] [--output FILE] [--result-store PATH] [--no-csv]"
+                  << " [--only-asns ASN,...] [--only-prefixes PREFIX,...] [--baseline STORE]"
+                  << " [--stats] [--stats-json FILE] [--huge-pages] [--policies FILE] [--aspa FILE]"
+                  << " [--collapse-stubs]\n"
+                  << "       " << argv[0] << " --sweep FILE <anns.csv> [threads] [--prefix-batch N]"
+                  << " [--graph-cache PATH | --no-graph-cache] [--only-asns ASN,...] [--only-prefixes PREFIX,...]"
+                  << " [--stats] [--stats-json FILE] [--huge-pages] [--policies FILE] [--aspa FILE]"
+                  << " [--collapse-stubs]\n"
+                  << "       " << argv[0] << " --batch | --socket PATH [threads] [--graph-cache PATH | --no-graph-cache]"
+                  << " [--only-asns ASN,...] [--only-prefixes PREFIX,...] [--huge-pages]\n";
+        return 1;
     }
-
-    for (auto& th : workers) {
-        th.join();
+    if (serve && (!output_path.empty() || !store_path.empty() || !baseline_path.empty() || prefix_batch != 0 ||
+                  print_stats || !stats_json.empty() || !policies_path.empty() || !aspa_path.empty() || collapse ||
+                  sweep_mode)) {
+        std::cerr << "--batch and --socket jobs name their own outputs; --output, --result-store, --baseline,"
+                  << " --prefix-batch, --stats, --policies, --collapse-stubs and --sweep do not apply\n";
+        return 1;
     }
-}
-
-int main(int argc, char* argv[]) {
-    if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <anns.csv> <rov_asns.csv> [threads]\n";
+    // Every sweep scenario names its own output file
+    if (sweep_mode && (!output_path.empty() || !store_path.empty() || !baseline_path.empty() || !write_csv)) {
+        std::cerr << "--sweep cannot be combined with --output, --result-store, --baseline or --no-csv\n";
         return 1;
     }
+    // Result stores record the ROV ASes of a run, not other policies
+    if (!policies_path.empty() && (!store_path.empty() || !baseline_path.empty())) {
+        std::cerr << "--policies cannot be combined with --result-store or --baseline\n";
+        return 1;
+    }
+    // Restored routes are written into every AS's rows, which collapsed stubs lack
+    if (!baseline_path.empty() && collapse) {
+        std::cerr << "--collapse-stubs cannot be combined with --baseline\n";
+        return 1;
+    }
+    if (!baseline_path.empty() && prefix_batch != 0) {
+        std::cerr << "--baseline cannot be combined with --prefix-batch\n";
+        return 1;
+    }
+    const std::string anns_path(serve ? "" : positional[0]);
+
+    // One ROV file per scenario: a plain run is a sweep of one lane, whose
+    // slots are the prefixes themselves
+    std::vector<SweepScenario> scenarios;
+    if (sweep_mode) {
+        if (!load_sweep_file(sweep_path, scenarios)) return 1;
+    } else if (!serve) {
+        scenarios.push_back(SweepScenario{std::string(positional[1]), output_path});
+    }
+    const RovSweep sweep(std::max<std::size_t>(scenarios.size(), 1));
 
+    // threads: omitted = 1, 0 = all hardware threads, otherwise used as given
     unsigned num_threads = 1;
-    if (argc >= 4) {
+    const std::size_t threads_arg = num_inputs;
+    if (positional.size() > threads_arg) {
         unsigned tmp = 0;
-        std::string_view tv(argv[3]);
+        std::string_view tv = positional[threads_arg];
         auto res = std::from_chars(tv.data(), tv.data() + tv.size(), tmp);
-        if (res.ec == std::errc() && tmp > 0) {
-            num_threads = std::min<unsigned>(tmp, 16u);
+        if (res.ec == std::errc()) {
+            num_threads = tmp > 0 ? tmp : std::max(1u, std::thread::hardware_concurrency());
         }
     }
-    unsigned hw = std::thread::hardware_concurrency();
-    if (hw > 0) {
-        num_threads = std::min<unsigned>(num_threads, hw);
+
+    RunStats stats(print_stats || !stats_json.empty());
+    ThreadPool pool(num_threads);
+
+    // --only-prefixes / --only-asns: comma-separated lists
+    std::unordered_set<std::string> only_prefixes;
+    for_each_list_item(only_prefixes_arg, [&](std::string_view item) { only_prefixes.emplace(item); });
+
+    // The ROV and announcement files do not need the graph until origins are
+    // resolved, so on a multi-core machine they are parsed on their own thread
+    // and pool while the graph loads. Both pools may use every thread;
+    // whichever side is done first leaves the cores to the other. The thread
+    // is joined on every path (jthread).
+    std::vector<std::unordered_set<ASN>> rov_asns(scenarios.size());
+    ParsedAnnouncements parsed_anns;
+    bool anns_opened = false;
+    auto parse_inputs = [&](ThreadPool& input_pool) {
+        for (std::size_t l = 0; l < scenarios.size(); ++l) {
+            rov_asns[l] = load_rov_asns(scenarios[l].rov_path, input_pool);
+        }
+        anns_opened = parse_announcements(anns_path, only_prefixes, parsed_anns, input_pool);
+    };
+    const bool overlap_inputs = !serve && std::thread::hardware_concurrency() > 1;
+    std::jthread input_thread;
+    if (overlap_inputs) {
+        input_thread = std::jthread([&] {
+            ThreadPool input_pool(num_threads);
+            parse_inputs(input_pool);
+        });
     }
 
+    // The preprocessed graph (adjacency + ranks) is cached in a binary snapshot
+    // next to the CAIDA file and reused as long as the file's hash matches
     ASGraph graph;
-    if (!graph.load_from_caida("data/as-rel.txt.bz2")) {
-        std::cerr << "Error loading CAIDA data\n";
-        return 1;
-    }
+    std::vector<std::vector<uint32_t>> ranks;
+    uint64_t source_hash = 0;
+    const bool have_hash = hash_file(caida_path, source_hash);
+    const bool use_cache = !graph_cache.empty() && have_hash;
+    stats.lap("hash caida");
+    if (use_cache && load_graph_snapshot(graph_cache, source_hash, graph, ranks)) {
+        std::cerr << "Loaded graph snapshot: " << graph.nodes.size() << " nodes, " << ranks.size() << " ranks\n";
+        stats.lap("load snapshot");
+    } else {
+        if (!graph.load_from_caida(caida_path, &pool)) {
+            std::cerr << "Error loading CAIDA data\n";
+            return 1;
+        }
+        stats.lap("load caida");
+
+        std::vector<ASN> cycle;
+        if (!graph.rank_topology(ranks, &pool, &cycle)) {
+            std::cerr << "Cycle detected in AS relationships:";
+            for (ASN asn : cycle) std::cerr << " " << asn << " ->";
+            std::cerr << " " << cycle.front() << " (customer -> provider). Exiting.\n";
+            return 1;
+        }
 
-    if (graph.detect_cycles()) {
-        std::cerr << "Cycle detected in AS relationships. Exiting.\n";
-        return 1;
+        stats.lap("rank topology");
+        graph.renumber_by_rank(ranks);
+        stats.lap("renumber");
+        if (use_cache && !save_graph_snapshot(graph_cache, graph, ranks, source_hash)) {
+            std::cerr << "Warning: could not write graph snapshot " << graph_cache << "\n";
+        }
+        stats.lap("save snapshot");
     }
 
-    auto ranks = graph.flatten_ranks();
-    std::vector<uint32_t> all_indices(graph.nodes.size());
-    for (uint32_t i = 0; i < all_indices.size(); ++i) {
-        all_indices[i] = i;
+    // Rows are written for these nodes only (all by default), in node order
+    std::vector<uint32_t> output_nodes;
+    if (only_asns_arg.empty()) {
+        output_nodes.resize(graph.nodes.size());
+        std::iota(output_nodes.begin(), output_nodes.end(), 0u);
+    } else {
+        for_each_list_item(only_asns_arg, [&](std::string_view item) {
+            ASN asn = 0;
+            auto res = std::from_chars(item.data(), item.data() + item.size(), asn);
+            auto it = graph.asn_to_index.end();
+            if (res.ec == std::errc()) it = graph.asn_to_index.find(asn);
+            if (it == graph.asn_to_index.end()) {
+                std::cerr << "Warning: --only-asns: unknown AS " << item << "\n";
+                return;
+            }
+            output_nodes.push_back(it->second);
+        });
+        std::sort(output_nodes.begin(), output_nodes.end());
+        output_nodes.erase(std::unique(output_nodes.begin(), output_nodes.end()), output_nodes.end());
     }
 
-    // Reserve some space for prefix dictionaries to reduce rehashing
-    g_prefix_to_id.reserve(1024);
-    g_id_to_prefix.reserve(1024);
+    const AsnLookup lookup(graph);
+
+    if (serve) {
+        ServeContext ctx;
+        ctx.graph = &graph;
+        ctx.ranks = &ranks;
+        ctx.lookup = &lookup;
+        ctx.output_nodes = output_nodes;
+        ctx.only_prefixes = &only_prefixes;
+        ctx.source_hash = source_hash;
+        ctx.huge_pages = huge_pages;
+        return serve_scenarios(ctx, pool, socket_path);
+    }
 
-    std::unordered_set<ASN> rov_asns;
-    std::ifstream rov_file(argv[2]);
-    if (rov_file.is_open()) {
-        std::string line;
-        while (std::getline(rov_file, line)) {
-            if (line.empty() || line[0] == '#') continue;
-            ASN asn = 0;
-            std::string_view v(line.data(), line.size());
-            auto first_non_ws = v.find_first_not_of(" \t\r\n");
-            if (first_non_ws == std::string_view::npos) continue;
-            auto last_non_ws = v.find_last_not_of(" \t\r\n");
-            v = v.substr(first_non_ws, last_non_ws - first_non_ws + 1);
-            auto res = std::from_chars(v.data(), v.data() + v.size(), asn);
-            if (res.ec != std::errc()) continue;
-            rov_asns.insert(asn);
-        }
-        rov_file.close();
+    // Import policies: ROV from the ROV file, anything else from --policies
+    std::vector<uint8_t> policies(graph.nodes.size(), 0);
+    if (!policies_path.empty() && !load_policies(policies_path, graph, policies)) return 1;
+    AspaRecords aspa;
+    if (!aspa_path.empty() && !aspa.load(aspa_path, lookup, graph.nodes.size())) return 1;
+    const PolicyContext policy_ctx{&graph, &lookup, aspa_path.empty() ? nullptr : &aspa};
+
+    // Overlapped: only the parsing time left after the graph was ready
+    if (overlap_inputs) {
+        input_thread.join();
+    } else {
+        parse_inputs(pool);
+    }
+    stats.lap("parse inputs");
+    if (!anns_opened) {
+        std::cerr << "Failed to open announcements file: " << anns_path << "\n";
+        return 1;
     }
 
+    // An AS that deploys ROV in some lanes drops ROV-invalid routes in those
+    // lanes' slots only; ROV from --policies applies to every lane
     std::vector<BGPState> states(graph.nodes.size());
+    std::vector<ASN> graph_rov_asns;  // ROV ASes of the graph, ascending
     for (uint32_t idx = 0; idx < graph.nodes.size(); ++idx) {
-        ASNode& node = graph.nodes[idx];
-        ASN asn = node.asn;
-        BGPState& st = states[idx];
-        st.rib.reserve(64);
-        st.recv_queue.reserve(64);
-        st.is_rov = (rov_asns.count(asn) > 0);
-        node.state = &st;
+        uint64_t rov_lanes = 0;
+        for (std::size_t l = 0; l < rov_asns.size(); ++l) {
+            if (rov_asns[l].count(graph.nodes[idx].asn) > 0) rov_lanes |= uint64_t{1} << l;
+        }
+        states[idx].policy = policies[idx] | (rov_lanes != 0 ? POLICY_ROV : 0);
+        if (!(policies[idx] & POLICY_ROV)) states[idx].rov_lanes = sweep.rov_lanes(rov_lanes);
+        if (states[idx].policy & POLICY_ROV) graph_rov_asns.push_back(graph.nodes[idx].asn);
     }
-
-    std::ifstream ann_file(argv[1]);
-    if (!ann_file.is_open()) {
-        std::cerr << "Failed to open announcements file: " << argv[1] << "\n";
-        return 1;
+    std::sort(graph_rov_asns.begin(), graph_rov_asns.end());
+
+    // Seeds are collected first: the dense RIB rows are sized by the number of prefixes
+    PrefixDict dict;
+    dict.ids.reserve(1024);
+    dict.names.reserve(1024);
+    std::vector<Seed> seeds;
+    resolve_announcements(parsed_anns, lookup, dict, seeds, pool);
+
+    // --collapse-stubs: stubs that originate a prefix in any batch keep their rows
+    if (collapse) {
+        std::vector<char> originates(graph.nodes.size(), 0);
+        for (const Seed& seed : seeds) originates[seed.node] = 1;
+        const std::size_t collapsed = collapse_stubs(graph, originates, states);
+        std::cerr << "Collapsed " << collapsed << " of " << graph.nodes.size() << " ASes into their providers\n";
     }
 
-    std::string line;
-    std::getline(ann_file, line);
-    while (std::getline(ann_file, line)) {
-        if (line.empty()) continue;
-        // Expected format: ASN,prefix,rov_invalid
-        size_t first_comma = line.find(',');
-        if (first_comma == std::string::npos) continue;
-        size_t second_comma = line.find(',', first_comma + 1);
-        if (second_comma == std::string::npos) continue;
-
-        std::string_view asn_view(line.data(), first_comma);
-        std::string_view prefix_view(line.data() + first_comma + 1, second_comma - first_comma - 1);
-        std::string_view rov_view(line.data() + second_comma + 1, line.size() - second_comma - 1);
-
-        // Trim whitespace from views
-        auto trim = [](std::string_view v) {
-            auto start = v.find_first_not_of(" \t\r\n");
-            if (start == std::string_view::npos) return std::string_view();
-            auto end = v.find_last_not_of(" \t\r\n");
-            return v.substr(start, end - start + 1);
-        };
-
-        asn_view = trim(asn_view);
-        prefix_view = trim(prefix_view);
-        rov_view = trim(rov_view);
-        if (asn_view.empty() || prefix_view.empty() || rov_view.empty()) continue;
-
-        ASN origin_asn = 0;
-        auto asn_res = std::from_chars(asn_view.data(), asn_view.data() + asn_view.size(), origin_asn);
-        if (asn_res.ec != std::errc()) continue;
+    // The simulated rows go into the result store, so a later --baseline run can
+    // tell which prefixes its inputs changed
+    std::vector<AnnRow> ann_rows;
+    if (!store_path.empty() || !baseline_path.empty()) {
+        ann_rows.reserve(seeds.size());
+        for (const Seed& seed : seeds) {
+            ann_rows.push_back(AnnRow{seed.ann.next_hop, seed.prefix_id, seed.ann.rov_invalid ? 1u : 0u});
+        }
+    }
 
-        bool rov_invalid = (rov_view == "True" || rov_view == "true" || rov_view == "1");
+    // Prefixes never interact, so they are propagated in independent batches of
+    // batch_size prefixes (default: one batch, or RovSweep::default_batch for a
+    // sweep). Peak memory is bounded by the rows of the batches in flight; each
+    // batch's rows are written as soon as it is done and, when batches run one
+    // after another, its table is reused.
+    const std::size_t total_prefixes = dict.names.size();
+    if (sweep_mode && prefix_batch == 0) prefix_batch = sweep.default_batch();
+    const std::size_t batch_size = (prefix_batch == 0 || prefix_batch > total_prefixes)
+        ? std::max<std::size_t>(total_prefixes, 1) : prefix_batch;
+    const std::size_t num_batches = (total_prefixes + batch_size - 1) / batch_size;
+
+    // Split seeds by batch with batch-local prefix IDs (file order kept, so the
+    // last announcement of an AS for a prefix still wins), one seed per lane
+    std::vector<std::vector<Seed>> batch_seeds(num_batches);
+    for (const Seed& seed : seeds) {
+        Seed local = seed;
+        for (std::size_t l = 0; l < sweep.lanes(); ++l) {
+            local.prefix_id = sweep.slot(static_cast<PrefixID>(seed.prefix_id % batch_size), l);
+            batch_seeds[seed.prefix_id / batch_size].push_back(local);
+        }
+    }
+    std::vector<Seed>().swap(seeds);
 
-        ASNode* origin_node = graph.get_node_by_asn(origin_asn);
-        if (!origin_node || !origin_node->state) continue;
+    stats.set_shape(pool.size(), graph.nodes.size(), ranks.size(), total_prefixes, num_batches);
+    stats.lap("read inputs");
 
-        // Materialize prefix string once for the dictionary
-        std::string prefix(prefix_view);
-        PrefixID pid = get_prefix_id(prefix);
-        Announcement ann;
-        ann.prefix_id = pid;
-        ann.as_path.reserve(16);
-        ann.as_path.push_back(origin_asn);
-        ann.next_hop = origin_asn;
-        ann.rel = ORIGIN;
-        ann.rov_invalid = rov_invalid;
+    auto batch_prefixes = [&](std::size_t b) {
+        return std::min(batch_size, total_prefixes - b * batch_size);
+    };
 
-        origin_node->state->rib[pid] = std::move(ann);
+    if (sweep_mode) {
+        std::cerr << "ROV sweep: " << sweep.lanes() << " scenarios, " << sweep.slots(1) << " slots per prefix\n";
+    }
+    std::vector<OutputSink> sinks(sweep.lanes());
+    std::vector<LaneSlots> lane_slots(sweep.lanes());
+    for (std::size_t l = 0; l < sweep.lanes(); ++l) lane_slots[l] = sweep.lane(l);
+    for (std::size_t l = 0; l < scenarios.size(); ++l) {
+        if (write_csv && !scenarios[l].output_path.empty() && !sinks[l].open(scenarios[l].output_path)) return 1;
     }
-    ann_file.close();
 
-    // Phase 1: UP (customers -> providers)
-    for (size_t r = 0; r < ranks.size(); ++r) {
-        const auto& idxs = ranks[r];
-        parallel_for_indices(idxs, num_threads, [&](uint32_t idx) {
-            if (idx >= graph.nodes.size()) return;
-            ASNode& node = graph.nodes[idx];
-            if (!node.state) return;
-            ASN asn = node.asn;
-            bgp_process_queue(*node.state, asn);
+    // The result store lists its nodes by ASN
+    ResultStoreWriter store;
+    std::vector<uint32_t> store_nodes;
+    if (!store_path.empty()) {
+        store_nodes = output_nodes;
+        std::sort(store_nodes.begin(), store_nodes.end(), [&](uint32_t a, uint32_t b) {
+            return graph.nodes[a].asn < graph.nodes[b].asn;
         });
-        // Sequential sending to avoid concurrent writes to neighbor queues
-        for (uint32_t idx : idxs) {
-            if (idx >= graph.nodes.size()) continue;
-            ASNode& node = graph.nodes[idx];
-            if (!node.state) continue;
-            send_announcements(graph, idx, node.providers, PROV);
-        }
+        std::vector<ASN> store_asns(store_nodes.size());
+        for (std::size_t k = 0; k < store_nodes.size(); ++k) store_asns[k] = graph.nodes[store_nodes[k]].asn;
+        if (!store.open(store_path, std::move(store_asns))) return 1;
     }
 
-    // Phase 2: PEERS
-    for (uint32_t idx : all_indices) {
-        ASNode& node = graph.nodes[idx];
-        if (!node.state) continue;
-        send_announcements(graph, idx, node.peers, PEER);
+    // --baseline: one batch over all prefixes, most of it restored from the store
+    ResultStore baseline;
+    std::vector<char> affected;
+    if (!baseline_path.empty()) {
+        if (!baseline.open(baseline_path) || !baseline_usable(baseline, graph, lookup, source_hash)) return 1;
+        affected = affected_prefixes(baseline, dict.names, ann_rows, graph_rov_asns);
+        stats.lap("open baseline");
     }
-    parallel_for_indices(all_indices, num_threads, [&](uint32_t idx) {
-        ASNode& node = graph.nodes[idx];
-        if (!node.state) return;
-        bgp_process_queue(*node.state, node.asn);
-    });
 
-    // Phase 3: DOWN (providers -> customers)
-    for (int r = static_cast<int>(ranks.size()) - 1; r >= 0; --r) {
-        const auto& idxs = ranks[static_cast<size_t>(r)];
-        for (uint32_t idx : idxs) {
-            if (idx >= graph.nodes.size()) continue;
-            ASNode& node = graph.nodes[idx];
-            if (!node.state) continue;
-            send_announcements(graph, idx, node.customers, CUST);
-        }
-        parallel_for_indices(idxs, num_threads, [&](uint32_t idx) {
-            if (idx >= graph.nodes.size()) return;
-            ASNode& node = graph.nodes[idx];
-            if (!node.state) return;
-            bgp_process_queue(*node.state, node.asn);
-        });
+    if (write_csv) {
+        for (OutputSink& sink : sinks) sink.write("asn,prefix,as_path\n");
     }
-
-    std::cout << "asn,prefix,as_path\n";
-    for (const auto& node : graph.nodes) {
-        if (!node.state) continue;
-        ASN asn = node.asn;
-        for (const auto& [prefix_id, ann] : node.state->rib) {
-            if (prefix_id >= g_id_to_prefix.size()) continue;
-            const std::string& prefix = g_id_to_prefix[prefix_id];
-            std::cout << asn << "," << prefix << ",";
-            for (size_t i = 0; i < ann.as_path.size(); ++i) {
-                if (i > 0) std::cout << "-";
-                std::cout << ann.as_path[i];
+    if (num_batches <= 1 || num_batches < num_threads) {
+        // Batches one after another, each using every thread
+        BGPTable table(huge_pages);
+        StoreSegment segment;
+        for (std::size_t b = 0; b < num_batches; ++b) {
+            const PrefixID prefix_base = static_cast<PrefixID>(b * batch_size);
+            if (!baseline_path.empty()) {
+                table.init(states, total_prefixes);
+                const std::size_t rerun = resimulate(baseline, graph, ranks, lookup, states, dict.names,
+                                                     ann_rows, affected, pool, stats.propagation());
+                std::cerr << "Incremental: " << rerun << " of " << total_prefixes << " prefixes propagated\n";
+            } else {
+                run_batch(graph, ranks, states, table, pool, batch_seeds[b], sweep.slots(batch_prefixes(b)),
+                          stats.propagation(), &policy_ctx);
+            }
+            stats.add_ribs(states);
+            stats.lap("propagate");
+            if (write_csv) {
+                write_ribs(sinks, graph, lookup, states, output_nodes, dict.names, prefix_base, pool, lane_slots);
+                stats.lap("write csv");
+            }
+            if (!store_path.empty()) {
+                build_store_segment(segment, lookup, states, store_nodes, prefix_base, batch_prefixes(b), pool);
+                store.append(segment);
+                stats.lap("write store");
             }
-            std::cout << "\n";
         }
+    } else {
+        // Enough batches to keep every thread busy: each thread propagates whole
+        // batches on its own state rows; output is buffered per batch and written
+        // in batch order. A thread holds a batch back while it is kReorderWindow
+        // batches per thread ahead of the next one to write, so one slow batch
+        // cannot pile up the output of all later ones.
+        struct BatchOutput {
+            std::vector<std::string> csv;  // per lane
+            StoreSegment segment;
+        };
+        std::atomic<std::size_t> next_batch{0};
+        std::mutex out_mutex;
+        std::condition_variable out_written;
+        const std::size_t window = kReorderWindow * pool.size();
+        std::vector<BatchOutput> finished(num_batches);
+        std::vector<char> done(num_batches, 0);
+        std::size_t next_out = 0;
+
+        pool.parallel_for(pool.size(), [](std::size_t) { return 1; }, [&](std::size_t) {
+            std::vector<BGPState> lane_states = states;
+            BGPTable table(huge_pages);
+            ThreadPool serial(1);
+            PropagationStats lane_prop;
+            RibSizes lane_ribs;
+            for (std::size_t b = next_batch++; b < num_batches; b = next_batch++) {
+                {
+                    // The batch at next_out is always claimed and never waits here
+                    std::unique_lock<std::mutex> lk(out_mutex);
+                    out_written.wait(lk, [&] { return b - next_out < window; });
+                }
+                const PrefixID prefix_base = static_cast<PrefixID>(b * batch_size);
+                BatchOutput out;
+                run_batch(graph, ranks, lane_states, table, serial, batch_seeds[b], sweep.slots(batch_prefixes(b)),
+                          stats.enabled() ? &lane_prop : nullptr, &policy_ctx);
+                if (stats.enabled()) lane_ribs.add(lane_states);
+                if (write_csv) {
+                    // Node by node, so the lanes of a prefix share cache lines along the path walks
+                    out.csv.resize(sweep.lanes());
+                    for (std::size_t k = 0; k < output_nodes.size(); ++k) {
+                        for (std::size_t l = 0; l < sweep.lanes(); ++l) {
+                            format_rib_rows(out.csv[l], graph, lookup, lane_states,
+                                            std::span<const uint32_t>(output_nodes).subspan(k, 1), dict.names,
+                                            prefix_base, lane_slots[l]);
+                        }
+                    }
+                }
+                if (!store_path.empty()) {
+                    build_store_segment(out.segment, lookup, lane_states, store_nodes, prefix_base,
+                                        batch_prefixes(b), serial);
+                }
+                std::lock_guard<std::mutex> lk(out_mutex);
+                finished[b] = std::move(out);
+                done[b] = 1;
+                while (next_out < num_batches && done[next_out]) {
+                    for (std::size_t l = 0; l < finished[next_out].csv.size(); ++l) {
+                        sinks[l].write(finished[next_out].csv[l]);
+                    }
+                    if (!store_path.empty()) store.append(finished[next_out].segment);
+                    finished[next_out] = BatchOutput();
+                    ++next_out;
+                }
+                out_written.notify_all();
+            }
+            std::lock_guard<std::mutex> lk(out_mutex);
+            stats.add(lane_prop, lane_ribs);
+        });
+        stats.lap("concurrent batches");
     }
 
+    if (!store_path.empty() && !store.finish(dict.names, source_hash, ann_rows, graph_rov_asns)) return 1;
+    stats.lap("finish outputs");
+    if (print_stats) stats.print();
+    if (!stats_json.empty() && !stats.write_json(stats_json)) return 1;
+    for (const OutputSink& sink : sinks) {
+        if (!sink.ok()) return 1;
+    }
     return 0;
 }
-
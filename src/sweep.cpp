@@ -0,0 +1,41 @@
+#include "sweep.h"
+#include <bit>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool load_sweep_file(const std::string& path, std::vector<SweepScenario>& scenarios) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        std::cerr << "Cannot open " << path << "\n";
+        return false;
+    }
+    std::string line;
+    for (std::size_t line_no = 1; std::getline(in, line); ++line_no) {
+        std::istringstream fields(line);
+        SweepScenario scenario;
+        if (!(fields >> scenario.rov_path) || scenario.rov_path[0] == '#') continue;
+        std::string extra;
+        if (!(fields >> scenario.output_path) || (fields >> extra)) {
+            std::cerr << path << ":" << line_no << ": expected <rov_asns.csv> <output.csv>\n";
+            return false;
+        }
+        scenarios.push_back(std::move(scenario));
+    }
+    if (scenarios.empty() || scenarios.size() > RovSweep::kMaxLanes) {
+        std::cerr << path << ": a sweep needs 1 to " << RovSweep::kMaxLanes << " scenarios, found "
+                  << scenarios.size() << "\n";
+        return false;
+    }
+    return true;
+}
+
+RovSweep::RovSweep(std::size_t num_lanes)
+    : num_lanes(num_lanes), lane_shift(static_cast<uint32_t>(std::bit_width(num_lanes - 1))) {}
+
+uint64_t RovSweep::rov_lanes(uint64_t lane_mask) const {
+    const uint32_t stride = uint32_t{1} << lane_shift;
+    uint64_t pattern = 0;
+    for (uint32_t b = 0; b < 64; b += stride) pattern |= lane_mask << b;
+    return pattern;
+}
@@ -0,0 +1,52 @@
+// ROV sweep - simulates up to 64 ROV deployments of one announcement set in a single propagation
+// Every prefix gets one RIB slot per scenario (lane); an AS drops ROV-invalid routes only in its ROV lanes
+#pragma once
+
+#include "announcement.h"
+#include "bgp.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One scenario of a sweep file: the ASes that deploy ROV and where its rows go
+struct SweepScenario {
+    std::string rov_path;
+    std::string output_path;
+};
+
+// Reads "<rov_asns.csv> <output.csv>" lines ('#' starts a comment line). False
+// with a message on stderr if the file cannot be read, a line is malformed or
+// it lists no scenario or more than RovSweep::kMaxLanes.
+bool load_sweep_file(const std::string& path, std::vector<SweepScenario>& scenarios);
+
+// Slot layout of a sweep: the lanes of a prefix are adjacent, padded to a
+// power of two so that every 64-slot bitmap word holds whole prefixes and
+// lane l sits at the same bits of every word. A run over n prefixes then
+// propagates n << shift() slots, with no per-lane work in the receive kernels
+// beyond masking ROV drops with BGPState::rov_lanes.
+class RovSweep {
+public:
+    static constexpr std::size_t kMaxLanes = 64;
+    // Slots per batch unless --prefix-batch says otherwise: the rows of a
+    // sweep grow with the lanes, and small batches keep them in cache
+    static constexpr std::size_t kDefaultBatchSlots = 64;
+
+    explicit RovSweep(std::size_t num_lanes);
+
+    std::size_t lanes() const { return num_lanes; }
+    std::size_t slots(std::size_t num_prefixes) const { return num_prefixes << lane_shift; }
+    std::size_t default_batch() const { return std::max<std::size_t>(1, kDefaultBatchSlots >> lane_shift); }
+    PrefixID slot(PrefixID prefix_id, std::size_t lane) const {
+        return static_cast<PrefixID>((prefix_id << lane_shift) | lane);
+    }
+    // Output selector of one lane
+    LaneSlots lane(std::size_t l) const { return LaneSlots{lane_shift, rov_lanes(uint64_t{1} << l)}; }
+    // BGPState::rov_lanes of an AS that deploys ROV in the lanes set in lane_mask
+    uint64_t rov_lanes(uint64_t lane_mask) const;
+
+private:
+    std::size_t num_lanes;
+    uint32_t lane_shift = 0;  // log2 of the lane stride
+};
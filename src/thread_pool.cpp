@@ -0,0 +1,99 @@
+#include "thread_pool.h"
+
+static inline uint64_t pack_range(uint64_t begin, uint64_t end) { return (begin << 32) | end; }
+static inline uint64_t range_begin(uint64_t r) { return r >> 32; }
+static inline uint64_t range_end(uint64_t r) { return r & 0xFFFFFFFFu; }
+
+ThreadPool::ThreadPool(unsigned threads)
+    : num_threads(threads > 0 ? threads : 1), slots(new Slot[threads > 0 ? threads : 1]) {
+    workers.reserve(num_threads - 1);
+    for (unsigned id = 1; id < num_threads; ++id) {
+        workers.emplace_back([this, id]() { worker_loop(id); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        stop = true;
+    }
+    job_cv.notify_all();
+    for (auto& th : workers) {
+        th.join();
+    }
+}
+
+void ThreadPool::run(std::size_t num_chunks, ChunkBody body, void* ctx) {
+    // Contiguous initial shares keep neighboring items (and their rows) on one thread
+    for (unsigned id = 0; id < num_threads; ++id) {
+        uint64_t begin = num_chunks * id / num_threads;
+        uint64_t end = num_chunks * (id + 1) / num_threads;
+        slots[id].range.store(pack_range(begin, end), std::memory_order_relaxed);
+    }
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        job_body = body;
+        job_ctx = ctx;
+        active = num_threads - 1;
+        ++generation;
+    }
+    job_cv.notify_all();
+
+    work(0);
+
+    std::unique_lock<std::mutex> lk(mutex);
+    done_cv.wait(lk, [this]() { return active == 0; });
+}
+
+void ThreadPool::work(unsigned id) {
+    std::size_t chunk = 0;
+    while (next_chunk(id, chunk)) {
+        job_body(job_ctx, chunk);
+    }
+}
+
+bool ThreadPool::next_chunk(unsigned id, std::size_t& chunk) {
+    // Own share: take from the front
+    std::atomic<uint64_t>& own = slots[id].range;
+    uint64_t r = own.load(std::memory_order_acquire);
+    while (range_begin(r) < range_end(r)) {
+        if (own.compare_exchange_weak(r, pack_range(range_begin(r) + 1, range_end(r)), std::memory_order_acq_rel)) {
+            chunk = static_cast<std::size_t>(range_begin(r));
+            return true;
+        }
+    }
+
+    // Steal the back half of another thread's share
+    for (unsigned step = 1; step < num_threads; ++step) {
+        std::atomic<uint64_t>& victim = slots[(id + step) % num_threads].range;
+        uint64_t v = victim.load(std::memory_order_acquire);
+        while (range_begin(v) < range_end(v)) {
+            uint64_t begin = range_begin(v), end = range_end(v);
+            uint64_t split = end - (end - begin + 1) / 2;
+            if (victim.compare_exchange_weak(v, pack_range(begin, split), std::memory_order_acq_rel)) {
+                // Own share is empty here, so nobody else modifies it concurrently
+                own.store(pack_range(split + 1, end), std::memory_order_release);
+                chunk = static_cast<std::size_t>(split);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(unsigned id) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            job_cv.wait(lk, [&]() { return stop || generation != seen; });
+            if (stop) return;
+            seen = generation;
+        }
+        work(id);
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            if (--active == 0) done_cv.notify_one();
+        }
+    }
+}
@@ -0,0 +1,102 @@
+// ThreadPool - persistent work-stealing pool shared by all parallel phases
+// Workers are started once and sleep between jobs; items are cut into chunks of similar cost
+#pragma once
+
+#include "mempool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    // num_threads includes the calling thread, which always takes part in a job
+    explicit ThreadPool(unsigned num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return num_threads; }
+
+    // Runs fn(i) for every i in [0, count) and returns when all calls are done.
+    // cost(i) estimates the work of item i: consecutive items are grouped into
+    // chunks of roughly equal total cost, each thread starts on its own share of
+    // chunks and steals half of another thread's remaining chunks when it runs dry.
+    template <typename Cost, typename Func>
+    void parallel_for(std::size_t count, Cost&& cost, Func&& fn) {
+        if (count == 0) return;
+        if (num_threads <= 1 || count < 2) {
+            for (std::size_t i = 0; i < count; ++i) fn(i);
+            return;
+        }
+
+        // Cost prefix sums and chunk bounds live in the caller's scratch pool,
+        // so the many steps of a propagation do not go through malloc
+        const std::size_t target_chunks = std::min<std::size_t>(count, std::size_t{num_threads} * kChunksPerThread);
+        ScratchArray<uint64_t> prefix(count + 1);
+        prefix[0] = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            prefix[i + 1] = prefix[i] + static_cast<uint64_t>(cost(i));
+        }
+        const uint64_t total = prefix[count];
+        ScratchArray<std::size_t> bounds(target_chunks + 1);
+        std::size_t num_bounds = 0;
+        bounds[num_bounds++] = 0;
+        for (std::size_t c = 1; c < target_chunks; ++c) {
+            // first item whose cumulative cost reaches c/target_chunks of the total
+            const uint64_t goal = total * c / target_chunks;
+            std::size_t lo = bounds[num_bounds - 1], hi = count;
+            while (lo < hi) {
+                std::size_t mid = lo + (hi - lo) / 2;
+                if (prefix[mid] < goal) lo = mid + 1; else hi = mid;
+            }
+            if (lo > bounds[num_bounds - 1] && lo < count) bounds[num_bounds++] = lo;
+        }
+        bounds[num_bounds++] = count;
+
+        struct Context {
+            const std::size_t* bounds;
+            Func* fn;
+        } ctx{bounds.data(), &fn};
+        run(num_bounds - 1, [](void* p, std::size_t chunk) {
+            auto* c = static_cast<Context*>(p);
+            const std::size_t end = c->bounds[chunk + 1];
+            for (std::size_t i = c->bounds[chunk]; i < end; ++i) (*c->fn)(i);
+        }, &ctx);
+    }
+
+private:
+    static constexpr std::size_t kChunksPerThread = 8;
+
+    using ChunkBody = void (*)(void*, std::size_t);
+
+    // Remaining chunk range [begin, end) of one thread, packed as begin << 32 | end
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> range{0};
+    };
+
+    void run(std::size_t num_chunks, ChunkBody body, void* ctx);
+    void work(unsigned id);
+    bool next_chunk(unsigned id, std::size_t& chunk);
+    void worker_loop(unsigned id);
+
+    unsigned num_threads;
+    std::vector<std::thread> workers;
+    std::unique_ptr<Slot[]> slots;
+
+    std::mutex mutex;
+    std::condition_variable job_cv;
+    std::condition_variable done_cv;
+    uint64_t generation = 0;
+    unsigned active = 0;
+    bool stop = false;
+
+    ChunkBody job_body = nullptr;
+    void* job_ctx = nullptr;
+};
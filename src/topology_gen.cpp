@@ -0,0 +1,181 @@
+#include "topology_gen.h"
+#include <algorithm>
+#include <bzlib.h>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <unordered_set>
+
+namespace {
+
+// SplitMix64: small, fast and identical on every platform (the <random>
+// distributions are not), so a seed always yields the same topology
+struct Rng {
+    uint64_t state;
+
+    explicit Rng(uint64_t seed) : state(seed) {}
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    // Uniform in [0, n)
+    uint32_t below(uint32_t n) { return static_cast<uint32_t>(((next() >> 32) * n) >> 32); }
+    // Uniform in [0, 1)
+    double unit() { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+};
+
+uint64_t pair_key(uint32_t a, uint32_t b) {
+    return a < b ? (uint64_t{a} << 32) | b : (uint64_t{b} << 32) | a;
+}
+
+}  // namespace
+
+void generate_topology(const TopologyParams& params, SyntheticTopology& topo) {
+    Rng rng(params.seed);
+    const uint32_t n = params.num_ases;
+    const uint32_t t1 = std::min(n, params.num_tier1 ? params.num_tier1 : std::clamp(n / 5000, 8u, 20u));
+    topo.num_tier1 = t1;
+    topo.links.clear();
+
+    // Distinct ASNs drawn from a range a few times larger than the graph
+    std::vector<ASN> range(std::size_t{n} * 4 + 1000);
+    std::iota(range.begin(), range.end(), 1u);
+    for (uint32_t i = 0; i < n; ++i) {
+        std::swap(range[i], range[i + rng.below(static_cast<uint32_t>(range.size() - i))]);
+    }
+    topo.asns.assign(range.begin(), range.begin() + n);
+    std::vector<ASN>().swap(range);
+
+    std::unordered_set<uint64_t> linked;
+    linked.reserve(std::size_t{n} * 2);
+    for (uint32_t i = 0; i < t1; ++i) {
+        for (uint32_t j = i + 1; j < t1; ++j) {
+            topo.links.push_back({topo.asns[i], topo.asns[j], true});
+            linked.insert(pair_key(i, j));
+        }
+    }
+
+    // Preferential attachment: an AS appears in weighted once plus once per
+    // customer, so large cones attract most new customers (power-law cone sizes).
+    // Providers are always placed earlier, which keeps the hierarchy acyclic.
+    std::vector<uint32_t> weighted(t1);
+    std::iota(weighted.begin(), weighted.end(), 0u);
+    std::vector<uint32_t> customers(n, 0);
+    for (uint32_t i = t1; i < n; ++i) {
+        uint32_t want = 1;
+        if (rng.unit() < params.multihoming) want = rng.unit() < 0.1 ? 3 : 2;
+        uint32_t picked[3];
+        uint32_t num_picked = 0;
+        for (uint32_t attempt = 0; num_picked < want && attempt < 16; ++attempt) {
+            const uint32_t p = weighted[rng.below(static_cast<uint32_t>(weighted.size()))];
+            if (std::find(picked, picked + num_picked, p) != picked + num_picked) continue;
+            picked[num_picked++] = p;
+        }
+        for (uint32_t k = 0; k < num_picked; ++k) {
+            const uint32_t p = picked[k];
+            topo.links.push_back({topo.asns[p], topo.asns[i], false});
+            linked.insert(pair_key(p, i));
+            weighted.push_back(p);
+            ++customers[p];
+        }
+        weighted.push_back(i);
+    }
+
+    // Peering among transit ASes, again weighted by cone size
+    std::vector<uint32_t> transit;
+    for (uint32_t i = t1; i < n; ++i) transit.insert(transit.end(), customers[i], i);
+    const std::size_t want_peers = static_cast<std::size_t>(params.peering * n);
+    std::size_t num_peers = 0;
+    for (std::size_t attempt = 0; !transit.empty() && num_peers < want_peers && attempt < want_peers * 4; ++attempt) {
+        const uint32_t a = transit[rng.below(static_cast<uint32_t>(transit.size()))];
+        const uint32_t b = transit[rng.below(static_cast<uint32_t>(transit.size()))];
+        if (a == b || !linked.insert(pair_key(a, b)).second) continue;
+        topo.links.push_back({topo.asns[a], topo.asns[b], true});
+        ++num_peers;
+    }
+}
+
+bool write_caida_bz2(const SyntheticTopology& topo, uint64_t seed, const std::string& path) {
+    FILE* fp = std::fopen(path.c_str(), "wb");
+    if (!fp) return false;
+    int err = BZ_OK;
+    BZFILE* bz = BZ2_bzWriteOpen(&err, fp, 9, 0, 0);
+    bool ok = err == BZ_OK;
+
+    auto flush = [&](std::string& text) {
+        if (ok && !text.empty()) {
+            BZ2_bzWrite(&err, bz, text.data(), static_cast<int>(text.size()));
+            ok = err == BZ_OK;
+        }
+        text.clear();
+    };
+
+    Rng rng(seed ^ 0xCA1DAull);
+    std::string text = "# synthetic topology: " + std::to_string(topo.asns.size()) + " ASes, seed " +
+                       std::to_string(seed) + "\n";
+    for (const SyntheticLink& link : topo.links) {
+        if (link.peer) {
+            text += std::to_string(link.a) + "|" + std::to_string(link.b) + "|1|bgp\n";
+        } else if (rng.below(2) == 0) {
+            text += std::to_string(link.a) + "|" + std::to_string(link.b) + "|0|bgp\n";
+        } else {
+            text += std::to_string(link.b) + "|" + std::to_string(link.a) + "|-1|bgp\n";
+        }
+        if (text.size() >= (1u << 20)) flush(text);
+    }
+    flush(text);
+
+    if (bz) BZ2_bzWriteClose(&err, bz, ok ? 0 : 1, nullptr, nullptr);
+    ok = ok && err == BZ_OK;
+    return std::fclose(fp) == 0 && ok;
+}
+
+void generate_announcements(const SyntheticTopology& topo, const AnnouncementParams& params,
+                            SyntheticAnnouncements& anns) {
+    Rng rng(params.seed ^ 0xA225ull);
+    const uint32_t n = static_cast<uint32_t>(topo.asns.size());
+    anns.prefixes.clear();
+    anns.rows.clear();
+    anns.rov_asns.clear();
+    if (n == 0) return;
+
+    for (uint32_t i = 0; i < params.num_prefixes; ++i) {
+        anns.prefixes.push_back(std::to_string(10 + (i >> 16)) + "." + std::to_string((i >> 8) & 255) + "." +
+                                std::to_string(i & 255) + ".0/24");
+        const ASN origin = topo.asns[rng.below(n)];
+        anns.rows.push_back({origin, i, false});
+        if (n > 1 && rng.unit() < params.hijacks) {
+            ASN attacker = origin;
+            while (attacker == origin) attacker = topo.asns[rng.below(n)];
+            anns.rows.push_back({attacker, i, true});
+        }
+    }
+
+    // ROV deployers: one ticket per AS plus one per customer link, so large
+    // transit ASes deploy far more often than stubs
+    std::vector<ASN> tickets(topo.asns);
+    for (const SyntheticLink& link : topo.links) {
+        if (!link.peer) tickets.push_back(link.a);
+    }
+    const std::size_t want = static_cast<std::size_t>(params.rov_share * n);
+    std::unordered_set<ASN> chosen;
+    for (std::size_t attempt = 0; chosen.size() < want && attempt < want * 8; ++attempt) {
+        chosen.insert(tickets[rng.below(static_cast<uint32_t>(tickets.size()))]);
+    }
+    anns.rov_asns.assign(chosen.begin(), chosen.end());
+    std::sort(anns.rov_asns.begin(), anns.rov_asns.end());
+}
+
+bool write_announcements(const SyntheticAnnouncements& anns, const std::string& anns_path,
+                         const std::string& rov_path) {
+    std::ofstream out(anns_path);
+    out << "asn,prefix,rov_invalid\n";
+    for (const SyntheticAnnouncement& row : anns.rows) {
+        out << row.asn << ',' << anns.prefixes[row.prefix] << ',' << (row.rov_invalid ? "True" : "False") << '\n';
+    }
+    std::ofstream rov(rov_path);
+    for (ASN asn : anns.rov_asns) rov << asn << '\n';
+    return static_cast<bool>(out.flush()) && static_cast<bool>(rov.flush());
+}
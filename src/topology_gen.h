@@ -0,0 +1,63 @@
+// Synthetic topologies - seeded generator of Internet-like AS graphs and announcement sets
+// Tier-1 clique, preferential-attachment customer cones and peering; written in the CAIDA format the loader reads
+#pragma once
+
+#include "announcement.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct TopologyParams {
+    uint32_t num_ases = 10000;
+    uint32_t num_tier1 = 0;      // 0 = scaled with num_ases (8..20)
+    double multihoming = 0.4;    // share of ASes with a second provider (a tenth of those get a third)
+    double peering = 0.3;        // peer links per AS, spread over ASes that have customers
+    uint64_t seed = 1;
+};
+
+// Provider -> customer or peer link between two ASes
+struct SyntheticLink {
+    ASN a;         // provider for customer links
+    ASN b;
+    bool peer;
+};
+
+// asns lists the tier-1s first, then every other AS in attachment order; a
+// provider always comes before its customers, so the graph is acyclic
+struct SyntheticTopology {
+    std::vector<ASN> asns;
+    std::vector<SyntheticLink> links;
+    uint32_t num_tier1 = 0;
+};
+
+void generate_topology(const TopologyParams& params, SyntheticTopology& topo);
+
+// Writes the links as "asn1|asn2|type|bgp" lines compressed with bzip2; half
+// of the customer links are written in customer -> provider form
+bool write_caida_bz2(const SyntheticTopology& topo, uint64_t seed, const std::string& path);
+
+struct AnnouncementParams {
+    uint32_t num_prefixes = 1000;
+    double hijacks = 0.1;     // share of prefixes with a second, ROV-invalid origin
+    double rov_share = 0.2;   // share of ASes deploying ROV, drawn with a bias towards large cones
+    uint64_t seed = 1;
+};
+
+struct SyntheticAnnouncement {
+    ASN asn;
+    uint32_t prefix;  // index into SyntheticAnnouncements::prefixes
+    bool rov_invalid;
+};
+
+struct SyntheticAnnouncements {
+    std::vector<std::string> prefixes;  // distinct /24s
+    std::vector<SyntheticAnnouncement> rows;
+    std::vector<ASN> rov_asns;
+};
+
+void generate_announcements(const SyntheticTopology& topo, const AnnouncementParams& params,
+                            SyntheticAnnouncements& anns);
+
+// Writes anns.csv and rov_asns.csv in the simulator's input formats
+bool write_announcements(const SyntheticAnnouncements& anns, const std::string& anns_path,
+                         const std::string& rov_path);